@@ -0,0 +1,131 @@
+import re
+import sys
+
+# Generates include/featurehash.h : a perfect hash (hash and displace) over the names of
+# include/cpufeatures.h so that sfp.HasFeature() resolves a name with two hashes and one compare.
+# Run it again each time a feature is added to include/cpufeatures.h.
+
+FEATURES = 'include/cpufeatures.h'
+OUTPUT   = 'include/featurehash.h'
+
+FNV_OFFSET = 0x811C9DC5
+FNV_PRIME  = 0x01000193
+MASK32     = 0xFFFFFFFF
+
+HEADER = '''/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Generated by genfeatures.py from cpufeatures.h : do not edit
+** Perfect hash of feature names (case insensitive, see feature_hash() in sfpplugin.c) :
+** bucket = feature_hash(name, 0) % FEATURE_HASH_BUCKETS
+** slot   = feature_hash(name, FeatureHashSeeds[bucket]) % FEATURE_HASH_SLOTS
+** FeatureHashSlots[slot] is the index of the only feature which may have this name (-1 if none)
+*/
+'''
+
+
+def feature_hash(name, seed):
+    """Must give the same results as feature_hash() in src/sfpplugin.c"""
+    h = (FNV_OFFSET ^ seed) & MASK32
+    for c in name.lower().encode('ascii'):
+        h ^= c
+        h = (h * FNV_PRIME) & MASK32
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK32
+    h ^= h >> 13
+    return h
+
+
+def read_names():
+    names = []
+    with open(FEATURES) as features:
+        for line in features:
+            match = re.match(r'\s*FEATURE\(\s*\w+\s*,\s*"([^"]+)"', line)
+            if match:
+                names.append(match.group(1))
+    lower = [name.lower() for name in names]
+    if len(set(lower)) != len(lower):
+        sys.exit("feature names must be unique (case insensitive)")
+    return names
+
+
+def build(names, slots_count, buckets_count):
+    buckets = [[] for _ in range(buckets_count)]
+    for index, name in enumerate(names):
+        buckets[feature_hash(name, 0) % buckets_count].append(index)
+
+    slots = [-1] * slots_count
+    seeds = [0] * buckets_count
+
+    # largest buckets first, they are the hardest to place
+    for bucket in sorted(range(buckets_count), key=lambda b: -len(buckets[b])):
+        if not buckets[bucket]:
+            continue
+        for seed in range(1, 1 << 16):
+            wanted = [feature_hash(names[index], seed) % slots_count for index in buckets[bucket]]
+            if len(set(wanted)) == len(wanted) and all(slots[slot] == -1 for slot in wanted):
+                break
+        else:
+            return None
+        seeds[bucket] = seed
+        for index, slot in zip(buckets[bucket], wanted):
+            slots[slot] = index
+
+    return seeds, slots
+
+
+def emit_array(ctype, name, size, values, per_line):
+    lines = ['static const %s %s[%s] =\n{\n' % (ctype, name, size)]
+    for start in range(0, len(values), per_line):
+        chunk = values[start:start + per_line]
+        lines.append('\t' + ', '.join('%4d' % value for value in chunk) + (',\n' if start + per_line < len(values) else '\n'))
+    lines.append('};\n')
+    return ''.join(lines)
+
+
+def main():
+    names = read_names()
+    slots_count = 1
+    while slots_count < len(names):
+        slots_count *= 2
+    buckets_count = max(1, len(names) // 4)
+
+    result = build(names, slots_count, buckets_count)
+    if result is None:
+        sys.exit("couldn't find a perfect hash, try more slots")
+    seeds, slots = result
+
+    with open(OUTPUT, 'w', newline='\n') as output:
+        output.write(HEADER)
+        output.write('\n#define FEATURE_HASH_COUNT   %d\n' % len(names))
+        output.write('#define FEATURE_HASH_BUCKETS %d\n' % buckets_count)
+        output.write('#define FEATURE_HASH_SLOTS   %d\n\n' % slots_count)
+        output.write(emit_array('uint16_t', 'FeatureHashSeeds', 'FEATURE_HASH_BUCKETS', seeds, 12))
+        output.write('\n')
+        output.write(emit_array('int16_t', 'FeatureHashSlots', 'FEATURE_HASH_SLOTS', slots, 16))
+
+    print("%s : %d names, %d buckets, %d slots" % (OUTPUT, len(names), buckets_count, slots_count))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,270 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* CPU features database : this file is included several times with a different definition of
+** FEATURE(id, name, leaf, subleaf, register, bit) to generate the feature enumeration, the
+** decoding table, ... (see sfpplugin.h and sfpplugin.c)
+** Features of leaf 1 are returned in cpu.features, all the others in cpu.extended_features,
+** in the order of this file. Adding a feature only takes a new line here, followed by
+** python genfeatures.py (regenerates the name lookup table featurehash.h).
+*/
+
+// Leaf 1 edx
+FEATURE(FPU,                   "FPU",                   0x00000001, 0, EDX,  0)
+FEATURE(VME,                   "VME",                   0x00000001, 0, EDX,  1)
+FEATURE(DE,                    "DE",                    0x00000001, 0, EDX,  2)
+FEATURE(PSE,                   "PSE",                   0x00000001, 0, EDX,  3)
+FEATURE(TSC,                   "TSC",                   0x00000001, 0, EDX,  4)
+FEATURE(MSR,                   "MSR",                   0x00000001, 0, EDX,  5)
+FEATURE(PAE,                   "PAE",                   0x00000001, 0, EDX,  6)
+FEATURE(MCE,                   "MCE",                   0x00000001, 0, EDX,  7)
+FEATURE(CX8,                   "CX8",                   0x00000001, 0, EDX,  8)
+FEATURE(APIC,                  "APIC",                  0x00000001, 0, EDX,  9)
+FEATURE(SEP,                   "SEP",                   0x00000001, 0, EDX, 11)
+FEATURE(MTRR,                  "MTRR",                  0x00000001, 0, EDX, 12)
+FEATURE(PGE,                   "PGE",                   0x00000001, 0, EDX, 13)
+FEATURE(MCA,                   "MCA",                   0x00000001, 0, EDX, 14)
+FEATURE(CMOV,                  "CMOV",                  0x00000001, 0, EDX, 15)
+FEATURE(PAT,                   "PAT",                   0x00000001, 0, EDX, 16)
+FEATURE(PSE_36,                "PSE-36",                0x00000001, 0, EDX, 17)
+FEATURE(PSN,                   "PSN",                   0x00000001, 0, EDX, 18)
+FEATURE(CLFSH,                 "CLFSH",                 0x00000001, 0, EDX, 19)
+FEATURE(DS,                    "DS",                    0x00000001, 0, EDX, 21)
+FEATURE(ACPI,                  "ACPI",                  0x00000001, 0, EDX, 22)
+FEATURE(MMX,                   "MMX",                   0x00000001, 0, EDX, 23)
+FEATURE(FXSR,                  "FXSR",                  0x00000001, 0, EDX, 24)
+FEATURE(SSE,                   "SSE",                   0x00000001, 0, EDX, 25)
+FEATURE(SSE2,                  "SSE2",                  0x00000001, 0, EDX, 26)
+FEATURE(SS,                    "SS",                    0x00000001, 0, EDX, 27)
+FEATURE(HTT,                   "HTT",                   0x00000001, 0, EDX, 28)
+FEATURE(TM,                    "TM",                    0x00000001, 0, EDX, 29)
+FEATURE(PBE,                   "PBE",                   0x00000001, 0, EDX, 31)
+
+// Leaf 1 ecx
+FEATURE(SSE3,                  "SSE3",                  0x00000001, 0, ECX,  0)
+FEATURE(PCLMULQDQ,             "PCLMULQDQ",             0x00000001, 0, ECX,  1)
+FEATURE(DTES64,                "DTES64",                0x00000001, 0, ECX,  2)
+FEATURE(MONITOR,               "MONITOR",               0x00000001, 0, ECX,  3)
+FEATURE(DS_CPL,                "DS-CPL",                0x00000001, 0, ECX,  4)
+FEATURE(VMX,                   "VMX",                   0x00000001, 0, ECX,  5)
+FEATURE(SMX,                   "SMX",                   0x00000001, 0, ECX,  6)
+FEATURE(EIST,                  "EIST",                  0x00000001, 0, ECX,  7)
+FEATURE(TM2,                   "TM2",                   0x00000001, 0, ECX,  8)
+FEATURE(SSSE3,                 "SSSE3",                 0x00000001, 0, ECX,  9)
+FEATURE(CNXT_ID,               "CNXT-ID",               0x00000001, 0, ECX, 10)
+FEATURE(SDBG,                  "SDBG",                  0x00000001, 0, ECX, 11)
+FEATURE(FMA,                   "FMA",                   0x00000001, 0, ECX, 12)
+FEATURE(CMPXCHG16B,            "CMPXCHG16B",            0x00000001, 0, ECX, 13)
+FEATURE(XTPR,                  "XTPR",                  0x00000001, 0, ECX, 14)
+FEATURE(PDCM,                  "PDCM",                  0x00000001, 0, ECX, 15)
+FEATURE(PCID,                  "PCID",                  0x00000001, 0, ECX, 17)
+FEATURE(DCA,                   "DCA",                   0x00000001, 0, ECX, 18)
+FEATURE(SSE4_1,                "SSE4.1",                0x00000001, 0, ECX, 19)
+FEATURE(SSE4_2,                "SSE4.2",                0x00000001, 0, ECX, 20)
+FEATURE(X2APIC,                "X2APIC",                0x00000001, 0, ECX, 21)
+FEATURE(MOVBE,                 "MOVBE",                 0x00000001, 0, ECX, 22)
+FEATURE(POPCNT,                "POPCNT",                0x00000001, 0, ECX, 23)
+FEATURE(TSC_DEADLINE,          "TSC-DEADLINE",          0x00000001, 0, ECX, 24)
+FEATURE(AESNI,                 "AESNI",                 0x00000001, 0, ECX, 25)
+FEATURE(XSAVE,                 "XSAVE",                 0x00000001, 0, ECX, 26)
+FEATURE(OSXSAVE,               "OSXSAVE",               0x00000001, 0, ECX, 27)
+FEATURE(AVX,                   "AVX",                   0x00000001, 0, ECX, 28)
+FEATURE(F16C,                  "F16C",                  0x00000001, 0, ECX, 29)
+FEATURE(RDRND,                 "RDRND",                 0x00000001, 0, ECX, 30)
+FEATURE(HYPERVISOR,            "HYPERVISOR",            0x00000001, 0, ECX, 31)
+
+// Leaf 7 sub-leaf 0 ebx
+FEATURE(FSGSBASE,              "FSGSBASE",              0x00000007, 0, EBX,  0)
+FEATURE(IA32_TSC_ADJ,          "IA32-TSC-ADJ",          0x00000007, 0, EBX,  1)
+FEATURE(SGX,                   "SGX",                   0x00000007, 0, EBX,  2)
+FEATURE(BMI1,                  "BMI1",                  0x00000007, 0, EBX,  3)
+FEATURE(HLE,                   "HLE",                   0x00000007, 0, EBX,  4)
+FEATURE(AVX2,                  "AVX2",                  0x00000007, 0, EBX,  5)
+FEATURE(FDP_EXCP,              "FDP-EXCP",              0x00000007, 0, EBX,  6)
+FEATURE(SMEP,                  "SMEP",                  0x00000007, 0, EBX,  7)
+FEATURE(BMI2,                  "BMI2",                  0x00000007, 0, EBX,  8)
+FEATURE(ENHANCED_RMS,          "ENHANCED-RMS",          0x00000007, 0, EBX,  9)
+FEATURE(INVPCID,               "INVPCID",               0x00000007, 0, EBX, 10)
+FEATURE(RTM,                   "RTM",                   0x00000007, 0, EBX, 11)
+FEATURE(RDT_M,                 "RDT-M",                 0x00000007, 0, EBX, 12)
+FEATURE(DEPR_FCSDS,            "DEPR-FCSDS",            0x00000007, 0, EBX, 13)
+FEATURE(MPX,                   "MPX",                   0x00000007, 0, EBX, 14)
+FEATURE(RDT_A,                 "RDT-A",                 0x00000007, 0, EBX, 15)
+FEATURE(AVX512F,               "AVX512F",               0x00000007, 0, EBX, 16)
+FEATURE(AVX512DQ,              "AVX512DQ",              0x00000007, 0, EBX, 17)
+FEATURE(RDSEED,                "RDSEED",                0x00000007, 0, EBX, 18)
+FEATURE(ADX,                   "ADX",                   0x00000007, 0, EBX, 19)
+FEATURE(SMAP,                  "SMAP",                  0x00000007, 0, EBX, 20)
+FEATURE(AVX512IFMA,            "AVX512IFMA",            0x00000007, 0, EBX, 21)
+FEATURE(CLFLUSHOPT,            "CLFLUSHOPT",            0x00000007, 0, EBX, 23)
+FEATURE(CLWB,                  "CLWB",                  0x00000007, 0, EBX, 24)
+FEATURE(INTEL_PTRACE,          "INTEL-PTRACE",          0x00000007, 0, EBX, 25)
+FEATURE(AVX512PF,              "AVX512PF",              0x00000007, 0, EBX, 26)
+FEATURE(AVX512ER,              "AVX512ER",              0x00000007, 0, EBX, 27)
+FEATURE(AVX512CD,              "AVX512CD",              0x00000007, 0, EBX, 28)
+FEATURE(SHA,                   "SHA",                   0x00000007, 0, EBX, 29)
+FEATURE(AVX512BW,              "AVX512BW",              0x00000007, 0, EBX, 30)
+FEATURE(AVX512VL,              "AVX512VL",              0x00000007, 0, EBX, 31)
+
+// Leaf 7 sub-leaf 0 ecx
+FEATURE(PREFETCHWT1,           "PREFETCHWT1",           0x00000007, 0, ECX,  0)
+FEATURE(AVX512VBMI,            "AVX512VBMI",            0x00000007, 0, ECX,  1)
+FEATURE(UMIP,                  "UMIP",                  0x00000007, 0, ECX,  2)
+FEATURE(PKU,                   "PKU",                   0x00000007, 0, ECX,  3)
+FEATURE(OSPKE,                 "OSPKE",                 0x00000007, 0, ECX,  4)
+FEATURE(WAITPKG,               "WAITPKG",               0x00000007, 0, ECX,  5)
+FEATURE(AVX512VBMI2,           "AVX512VBMI2",           0x00000007, 0, ECX,  6)
+FEATURE(CET_SS,                "CET-SS",                0x00000007, 0, ECX,  7)
+FEATURE(GFNI,                  "GFNI",                  0x00000007, 0, ECX,  8)
+FEATURE(VAES,                  "VAES",                  0x00000007, 0, ECX,  9)
+FEATURE(VPCLMULQDQ,            "VPCLMULQDQ",            0x00000007, 0, ECX, 10)
+FEATURE(AVX512VNNI,            "AVX512VNNI",            0x00000007, 0, ECX, 11)
+FEATURE(AVX512BITALG,          "AVX512BITALG",          0x00000007, 0, ECX, 12)
+FEATURE(TME,                   "TME",                   0x00000007, 0, ECX, 13)
+FEATURE(AVX512VPOPCNTDQ,       "AVX512VPOPCNTDQ",       0x00000007, 0, ECX, 14)
+FEATURE(LA57,                  "LA57",                  0x00000007, 0, ECX, 16)
+FEATURE(RPID,                  "RPID",                  0x00000007, 0, ECX, 22)
+FEATURE(KL,                    "KL",                    0x00000007, 0, ECX, 23)
+FEATURE(BUS_LOCK_DETECT,       "BUS-LOCK-DETECT",       0x00000007, 0, ECX, 24)
+FEATURE(CLDEMOTE,              "CLDEMOTE",              0x00000007, 0, ECX, 25)
+FEATURE(MOVDIRI,               "MOVDIRI",               0x00000007, 0, ECX, 27)
+FEATURE(MOVDIR64B,             "MOVDIR64B",             0x00000007, 0, ECX, 28)
+FEATURE(ENQCMD,                "ENQCMD",                0x00000007, 0, ECX, 29)
+FEATURE(SGX_LC,                "SGX-LC",                0x00000007, 0, ECX, 30)
+FEATURE(PKS,                   "PKS",                   0x00000007, 0, ECX, 31)
+
+// Leaf 7 sub-leaf 0 edx
+FEATURE(AVX512_4VNNIW,         "AVX512-4VNNIW",         0x00000007, 0, EDX,  2)
+FEATURE(AVX512_4FMAPS,         "AVX512-4FMAPS",         0x00000007, 0, EDX,  3)
+FEATURE(FSRM,                  "FSRM",                  0x00000007, 0, EDX,  4)
+FEATURE(UINTR,                 "UINTR",                 0x00000007, 0, EDX,  5)
+FEATURE(AVX512_VP2INTERSECT,   "AVX512-VP2INTERSECT",   0x00000007, 0, EDX,  8)
+FEATURE(MD_CLEAR,              "MD-CLEAR",              0x00000007, 0, EDX, 10)
+FEATURE(SERIALIZE,             "SERIALIZE",             0x00000007, 0, EDX, 14)
+FEATURE(HYBRID,                "HYBRID",                0x00000007, 0, EDX, 15)
+FEATURE(TSXLDTRK,              "TSXLDTRK",              0x00000007, 0, EDX, 16)
+FEATURE(PCONFIG,               "PCONFIG",               0x00000007, 0, EDX, 18)
+FEATURE(CET_IBT,               "CET-IBT",               0x00000007, 0, EDX, 20)
+FEATURE(AMX_BF16,              "AMX-BF16",              0x00000007, 0, EDX, 22)
+FEATURE(AVX512_FP16,           "AVX512-FP16",           0x00000007, 0, EDX, 23)
+FEATURE(AMX_TILE,              "AMX-TILE",              0x00000007, 0, EDX, 24)
+FEATURE(AMX_INT8,              "AMX-INT8",              0x00000007, 0, EDX, 25)
+FEATURE(IBRS_IBPB,             "IBRS-IBPB",             0x00000007, 0, EDX, 26)
+FEATURE(STIBP,                 "STIBP",                 0x00000007, 0, EDX, 27)
+FEATURE(L1D_FLUSH,             "L1D-FLUSH",             0x00000007, 0, EDX, 28)
+FEATURE(ARCH_CAPABILITIES,     "ARCH-CAPABILITIES",     0x00000007, 0, EDX, 29)
+FEATURE(SSBD,                  "SSBD",                  0x00000007, 0, EDX, 31)
+
+// Leaf 7 sub-leaf 1 eax
+FEATURE(SHA512,                "SHA512",                0x00000007, 1, EAX,  0)
+FEATURE(SM3,                   "SM3",                   0x00000007, 1, EAX,  1)
+FEATURE(SM4,                   "SM4",                   0x00000007, 1, EAX,  2)
+FEATURE(RAO_INT,               "RAO-INT",               0x00000007, 1, EAX,  3)
+FEATURE(AVX_VNNI,              "AVX-VNNI",              0x00000007, 1, EAX,  4)
+FEATURE(AVX512_BF16,           "AVX512-BF16",           0x00000007, 1, EAX,  5)
+FEATURE(LASS,                  "LASS",                  0x00000007, 1, EAX,  6)
+FEATURE(CMPCCXADD,             "CMPCCXADD",             0x00000007, 1, EAX,  7)
+FEATURE(FZLRM,                 "FZLRM",                 0x00000007, 1, EAX, 10)
+FEATURE(FSRS,                  "FSRS",                  0x00000007, 1, EAX, 11)
+FEATURE(FSRCS,                 "FSRCS",                 0x00000007, 1, EAX, 12)
+FEATURE(FRED,                  "FRED",                  0x00000007, 1, EAX, 17)
+FEATURE(LKGS,                  "LKGS",                  0x00000007, 1, EAX, 18)
+FEATURE(WRMSRNS,               "WRMSRNS",               0x00000007, 1, EAX, 19)
+FEATURE(AMX_FP16,              "AMX-FP16",              0x00000007, 1, EAX, 21)
+FEATURE(HRESET,                "HRESET",                0x00000007, 1, EAX, 22)
+FEATURE(AVX_IFMA,              "AVX-IFMA",              0x00000007, 1, EAX, 23)
+FEATURE(LAM,                   "LAM",                   0x00000007, 1, EAX, 26)
+FEATURE(MSRLIST,               "MSRLIST",               0x00000007, 1, EAX, 27)
+
+// Leaf 7 sub-leaf 1 edx
+FEATURE(AVX_VNNI_INT8,         "AVX-VNNI-INT8",         0x00000007, 1, EDX,  4)
+FEATURE(AVX_NE_CONVERT,        "AVX-NE-CONVERT",        0x00000007, 1, EDX,  5)
+FEATURE(AMX_COMPLEX,           "AMX-COMPLEX",           0x00000007, 1, EDX,  8)
+FEATURE(AVX_VNNI_INT16,        "AVX-VNNI-INT16",        0x00000007, 1, EDX, 10)
+FEATURE(PREFETCHI,             "PREFETCHI",             0x00000007, 1, EDX, 14)
+FEATURE(AVX10,                 "AVX10",                 0x00000007, 1, EDX, 19)
+FEATURE(APX_F,                 "APX-F",                 0x00000007, 1, EDX, 21)
+
+// Leaf 0xD sub-leaf 1 eax
+FEATURE(XSAVEOPT,              "XSAVEOPT",              0x0000000D, 1, EAX,  0)
+FEATURE(XSAVEC,                "XSAVEC",                0x0000000D, 1, EAX,  1)
+FEATURE(XGETBV_ECX1,           "XGETBV-ECX1",           0x0000000D, 1, EAX,  2)
+FEATURE(XSAVES,                "XSAVES",                0x0000000D, 1, EAX,  3)
+FEATURE(XFD,                   "XFD",                   0x0000000D, 1, EAX,  4)
+
+// Leaf 0x80000001 ecx
+FEATURE(LAHF_SAHF,             "LAHF-SAHF",             0x80000001, 0, ECX,  0)
+FEATURE(CMP_LEGACY,            "CMP-LEGACY",            0x80000001, 0, ECX,  1)
+FEATURE(SVM,                   "SVM",                   0x80000001, 0, ECX,  2)
+FEATURE(CR8_LEGACY,            "CR8-LEGACY",            0x80000001, 0, ECX,  4)
+FEATURE(LZCNT,                 "LZCNT",                 0x80000001, 0, ECX,  5)
+FEATURE(SSE4A,                 "SSE4A",                 0x80000001, 0, ECX,  6)
+FEATURE(MISALIGNSSE,           "MISALIGNSSE",           0x80000001, 0, ECX,  7)
+FEATURE(PREFETCHW,             "PREFETCHW",             0x80000001, 0, ECX,  8)
+FEATURE(OSVW,                  "OSVW",                  0x80000001, 0, ECX,  9)
+FEATURE(IBS,                   "IBS",                   0x80000001, 0, ECX, 10)
+FEATURE(XOP,                   "XOP",                   0x80000001, 0, ECX, 11)
+FEATURE(SKINIT,                "SKINIT",                0x80000001, 0, ECX, 12)
+FEATURE(WDT,                   "WDT",                   0x80000001, 0, ECX, 13)
+FEATURE(LWP,                   "LWP",                   0x80000001, 0, ECX, 15)
+FEATURE(FMA4,                  "FMA4",                  0x80000001, 0, ECX, 16)
+FEATURE(TCE,                   "TCE",                   0x80000001, 0, ECX, 17)
+FEATURE(NODEID_MSR,            "NODEID-MSR",            0x80000001, 0, ECX, 19)
+FEATURE(TBM,                   "TBM",                   0x80000001, 0, ECX, 21)
+FEATURE(TOPOEXT,               "TOPOEXT",               0x80000001, 0, ECX, 22)
+FEATURE(PERFCTR_CORE,          "PERFCTR-CORE",          0x80000001, 0, ECX, 23)
+FEATURE(PERFCTR_NB,            "PERFCTR-NB",            0x80000001, 0, ECX, 24)
+FEATURE(DBX,                   "DBX",                   0x80000001, 0, ECX, 26)
+FEATURE(PERFTSC,               "PERFTSC",               0x80000001, 0, ECX, 27)
+FEATURE(PERFCTR_LLC,           "PERFCTR-LLC",           0x80000001, 0, ECX, 28)
+FEATURE(MONITORX,              "MONITORX",              0x80000001, 0, ECX, 29)
+
+// Leaf 0x80000001 edx
+FEATURE(SYSCALL_SYSRET,        "SYSCALL-SYSRET",        0x80000001, 0, EDX, 11)
+FEATURE(EXD,                   "EXD",                   0x80000001, 0, EDX, 20)
+FEATURE(MMX_EXT,               "MMX_ext",               0x80000001, 0, EDX, 22)
+FEATURE(1GB_PAGES,             "1GB_pages",             0x80000001, 0, EDX, 26)
+FEATURE(RDTSCP,                "RDTSCP",                0x80000001, 0, EDX, 27)
+FEATURE(64_BIT_MODE,           "64_bit_mode",           0x80000001, 0, EDX, 29)
+FEATURE(3DNOW_EXT,             "3DNow_ext",             0x80000001, 0, EDX, 30)
+FEATURE(3DNOW,                 "3DNow",                 0x80000001, 0, EDX, 31)
+
+// Leaf 0x80000007 edx
+FEATURE(INVARIANT_TSC,         "INVARIANT-TSC",         0x80000007, 0, EDX,  8)
+
+// Leaf 0x80000008 ebx (AMD)
+FEATURE(CLZERO,                "CLZERO",                0x80000008, 0, EBX,  0)
+FEATURE(INSTRETCNT_MSR,        "INSTRETCNT-MSR",        0x80000008, 0, EBX,  1)
+FEATURE(RSTR_FP_ERR_PTRS,      "RSTR-FP-ERR-PTRS",      0x80000008, 0, EBX,  2)
+FEATURE(INVLPGB,               "INVLPGB",               0x80000008, 0, EBX,  3)
+FEATURE(RDPRU,                 "RDPRU",                 0x80000008, 0, EBX,  4)
+FEATURE(MCOMMIT,               "MCOMMIT",               0x80000008, 0, EBX,  8)
+FEATURE(WBNOINVD,              "WBNOINVD",              0x80000008, 0, EBX,  9)
+FEATURE(AMD_IBPB,              "AMD-IBPB",              0x80000008, 0, EBX, 12)
+FEATURE(AMD_IBRS,              "AMD-IBRS",              0x80000008, 0, EBX, 14)
+FEATURE(AMD_STIBP,             "AMD-STIBP",             0x80000008, 0, EBX, 15)
+FEATURE(AMD_SSBD,              "AMD-SSBD",              0x80000008, 0, EBX, 24)
+FEATURE(VIRT_SSBD,             "VIRT-SSBD",             0x80000008, 0, EBX, 25)
+FEATURE(CPPC,                  "CPPC",                  0x80000008, 0, EBX, 27)
+FEATURE(PSFD,                  "PSFD",                  0x80000008, 0, EBX, 28)
+FEATURE(BTC_NO,                "BTC-NO",                0x80000008, 0, EBX, 29)
@@ -0,0 +1,62 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Generated by genfeatures.py from cpufeatures.h : do not edit
+** Perfect hash of feature names (case insensitive, see feature_hash() in sfpplugin.c) :
+** bucket = feature_hash(name, 0) % FEATURE_HASH_BUCKETS
+** slot   = feature_hash(name, FeatureHashSeeds[bucket]) % FEATURE_HASH_SLOTS
+** FeatureHashSlots[slot] is the index of the only feature which may have this name (-1 if none)
+*/
+
+#define FEATURE_HASH_COUNT   216
+#define FEATURE_HASH_BUCKETS 54
+#define FEATURE_HASH_SLOTS   256
+
+static const uint16_t FeatureHashSeeds[FEATURE_HASH_BUCKETS] =
+{
+	   4,   16,    0,   17,    5,    8,   10,   29,    2,    2,   11,    1,
+	  12,   10,   16,    4,    6,    5,   20,    3,    4,   83,    0,    2,
+	  13,   97,   22,   22,    4,   17,   17,   15,    2,   83,  135,    2,
+	  17,    7,   32,   80,    1,    2,    2,    6,   70,    5,    2,    2,
+	 139,    1,   86,    2,  210,    5
+};
+
+static const int16_t FeatureHashSlots[FEATURE_HASH_SLOTS] =
+{
+	  -1,  191,   -1,  171,   82,   78,   72,   42,  176,   11,   55,   -1,  114,  174,   38,  190,
+	  -1,    9,   -1,   33,   50,   -1,   39,  111,  105,    5,  138,   -1,  197,   22,   -1,   74,
+	  61,  156,   24,   95,   29,   63,  200,  119,   84,    6,   17,   49,   -1,  187,   51,  145,
+	 135,  182,  185,   83,  110,   93,  149,   65,   62,  113,  103,   90,  188,   98,   -1,   99,
+	  -1,   -1,  100,   73,   34,  160,   10,   46,  194,  123,   -1,   -1,  116,   35,  206,    8,
+	  77,   41,   45,   59,   32,  136,  134,  196,  172,  118,   -1,   92,   91,  152,  115,   97,
+	  -1,  137,   68,  208,  203,  214,   58,  104,  146,   48,  201,   44,  143,  150,  120,  129,
+	 122,  131,   54,  106,  162,  204,   43,  117,   56,    4,  186,  179,   -1,   -1,   20,  161,
+	  67,   -1,  170,  121,    1,  108,   -1,   60,   79,   52,  198,   57,  180,   -1,   23,    3,
+	 167,  155,   15,  132,   86,  101,   27,  211,   89,    0,  165,   13,  147,  168,  151,   -1,
+	  87,   94,  202,  126,   -1,  210,   76,   -1,    2,   -1,  144,   -1,   -1,  109,   64,   -1,
+	 107,  205,   -1,  207,   28,   18,   75,  153,   -1,   21,    7,  130,  127,  213,  184,   36,
+	 215,  169,  124,   25,   70,   40,  173,   37,   -1,  177,   81,  140,   30,  157,   12,  189,
+	 102,  192,   -1,   -1,   80,   47,   96,   -1,  139,  125,  175,  142,   71,  154,  141,  193,
+	  66,   -1,   -1,   85,  164,   26,   -1,  148,   31,  199,   88,  128,  181,  195,  133,   14,
+	 159,   -1,  212,   -1,  166,  163,  112,  209,   16,   53,   69,  183,  178,   19,   -1,  158
+};
@@ -21,13 +21,780 @@
 ** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#ifdef _MSC_VER
+#define MSVC_COMPILER 1
+#else
+#define MSVC_COMPILER 0
+#endif
+
+#if MSVC_COMPILER
+#  include <intrin.h>
+#else
+#  include <cpuid.h>
+#  include <x86intrin.h>
+#endif
+
+#include <stdint.h>
+
+// Visual C++ got a standard snprintf() in 2015 only : _snprintf() neither terminates on overflow nor returns the needed size
+#if MSVC_COMPILER && _MSC_VER < 1900
+#include <stdarg.h>
+#include <stdio.h>
+
+static __inline int msvc_snprintf(char *buffer, size_t size, const char *format, ...)
+{
+	va_list args;
+	int needed = 0;
+
+	va_start(args, format);
+	needed = _vscprintf(format, args);
+	va_end(args);
+
+	if (size > 0)
+	{
+		va_start(args, format);
+		_vsnprintf(buffer, size - 1, format, args);
+		va_end(args);
+
+		buffer[size - 1] = '\0';
+	}
+
+	return needed;
+}
+
+#define snprintf msvc_snprintf
+#endif
+
+// shared between the script thread and native threads (benchmarks, monitor)
+#if MSVC_COMPILER
+#  define atomic_increment(value) _InterlockedIncrement(value)
+#  define atomic_exchange(target, value) _InterlockedExchange(target, value)
+#  define memory_barrier() _mm_mfence()
+#else
+#  define atomic_increment(value) __sync_add_and_fetch(value, 1)
+#  define atomic_exchange(target, value) __sync_lock_test_and_set(target, value)
+#  define memory_barrier() __sync_synchronize()
+#endif
+
 #ifdef HW_AMIGA
 int initamigastuff(void);
 void freeamigastuff(void);
 #endif
 
+// number of standard (0x00000000...) and extended (0x80000000...) leaves kept in a snapshot
+#define CPUID_STD_LEAVES   0x20
+#define CPUID_EXT_LEAVES   0x21
+// maximum number of sub-leaves kept for leaves which have some (4, 7, 0xB, ...)
+#define CPUID_SUBLEAVES    8
+
+/* Every CPUID leaf the plugin is interested in, captured once (see cpuid_snapshot()) */
+typedef struct
+{
+	uint32_t max_standard_leaf;
+	uint32_t max_extended_leaf;
+	uint32_t std[CPUID_STD_LEAVES][CPUID_SUBLEAVES][4];
+	uint32_t ext[CPUID_EXT_LEAVES][CPUID_SUBLEAVES][4];
+	uint64_t xcr0;      // state components enabled by the OS (XGETBV 0), 0 if OSXSAVE is not set
+
+} cpuid_snapshot_t;
+
+void cpuid_capture(cpuid_snapshot_t *snap);
+void cpuid_capture_cpu(cpuid_snapshot_t *snap);
+const cpuid_snapshot_t *cpuid_snapshot(void);
+const uint32_t *cpuid_leaf(const cpuid_snapshot_t *snap, uint32_t function, uint32_t subfunction);
+
+// registers, as indexed in the arrays returned by cpuid_leaf()
+#define CPUID_EAX 0
+#define CPUID_EBX 1
+#define CPUID_ECX 2
+#define CPUID_EDX 3
+
+// one identifier per feature of cpufeatures.h : FEATURE_FPU, FEATURE_SSE4_1, ...
+enum
+{
+#define FEATURE(id, name, leaf, subleaf, reg, bit) FEATURE_##id,
+#include "cpufeatures.h"
+#undef FEATURE
+	FEATURES_COUNT
+};
+
+/* Where a feature is reported by CPUID */
+typedef struct
+{
+	const char *name;
+	uint32_t leaf;
+	uint8_t subleaf;
+	uint8_t reg;        // CPUID_EAX ... CPUID_EDX
+	uint8_t bit;
+
+} feature_t;
+
+extern const feature_t Features[FEATURES_COUNT];
+
+/* One bit per feature of Features[], set if the processor has it */
+typedef struct
+{
+	uint32_t bits[(FEATURES_COUNT + 31) / 32];
+
+} feature_set_t;
+
+#define feature_test(set, id) (((set)->bits[(id) >> 5] >> ((id) & 31)) & 1)
+
+void feature_set_capture(const cpuid_snapshot_t *snap, feature_set_t *set);
+const feature_set_t *feature_set(void);
+int feature_lookup(const char *name);
+
+// XCR0 state components
+#define XCR0_X87          (1 << 0)
+#define XCR0_SSE          (1 << 1)
+#define XCR0_AVX          (1 << 2)   // upper halves of YMM registers
+#define XCR0_OPMASK       (1 << 5)   // k0-k7
+#define XCR0_ZMM_HI256    (1 << 6)   // upper halves of ZMM0-15
+#define XCR0_HI16_ZMM     (1 << 7)   // ZMM16-31
+#define XCR0_TILECFG      (1 << 17)
+#define XCR0_TILEDATA     (1 << 18)
+
+#define XCR0_AVX_STATE    (XCR0_SSE | XCR0_AVX)
+#define XCR0_AVX512_STATE (XCR0_AVX_STATE | XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM)
+#define XCR0_AMX_STATE    (XCR0_TILECFG | XCR0_TILEDATA)
+
+// x86-64 micro-architecture levels (as defined by the x86-64 psABI)
+#define ISA_LEVEL_NONE     0   // not a 64 bits processor
+#define ISA_LEVEL_BASELINE 1   // x86-64
+#define ISA_LEVEL_V2       2   // x86-64-v2
+#define ISA_LEVEL_V3       3   // x86-64-v3
+#define ISA_LEVEL_V4       4   // x86-64-v4
+
+int isa_level(const cpuid_snapshot_t *snap);
+
+/* One value of the sys table, as reported by fill_systable() */
+typedef struct
+{
+	char *group;    // sub-table holding the value (NULL when directly in sys table)
+	char *key;
+	char *value;
+
+} sysentry_t;
+
+/* Native copy of the sys table, filled through new_table()/add_entry()/close_table() */
+typedef struct
+{
+	sysentry_t *entries;
+	int count;
+	int capacity;
+	char *group;    // sub-table currently being filled
+
+} systable_t;
+
+#define CACHE_DATA        1
+#define CACHE_INSTRUCTION 2
+#define CACHE_UNIFIED     3
+
+#define MAX_CACHE_LEVELS  CPUID_SUBLEAVES
+
+/* One cache of the hierarchy, as enumerated by CPUID leaf 4 (Intel) / 0x8000001D (AMD) */
+typedef struct
+{
+	int level;
+	int type;           // CACHE_DATA, CACHE_INSTRUCTION or CACHE_UNIFIED
+	uint32_t size;      // in bytes
+	int ways;
+	int line_size;      // in bytes
+	int sets;
+	int partitions;
+	int sharing;        // number of logical processors sharing this cache
+	int inclusive;
+	uint32_t os_size;   // size reported by operating system (0 if unknown)
+
+} cache_level_t;
+
+int cpuid_caches(const cpuid_snapshot_t *snap, cache_level_t *caches, int max);
+int cache_hierarchy(cache_level_t *caches, int max);
+
+// core types of CPUID leaf 0x1A (hybrid processors)
+#define CORE_TYPE_ATOM 0x20     // efficiency cores
+#define CORE_TYPE_CORE 0x40     // performance cores
+
+/* CPUID identity of one logical processor, captured by a thread pinned on it */
+typedef struct
+{
+	int cpu;
+	int pinned;                 // FALSE if the thread couldn't be moved to this processor
+	uint32_t signature;         // leaf 1 EAX (family, model, stepping)
+	uint32_t core_type;         // leaf 0x1A : CORE_TYPE_* (0 if the processor isn't hybrid)
+	uint32_t native_model;      // leaf 0x1A : native model id of this kind of core
+	int cache_count;
+	cache_level_t caches[MAX_CACHE_LEVELS];
+	feature_set_t features;
+
+} cpu_identity_t;
+
+int cpu_identities(cpu_identity_t **identities);
+
+/* Topology of the processor the calling thread runs on, as seen by CPUID leaves 0xB/0x1F/0x8000001E */
+typedef struct
+{
+	int source;                 // leaf the topology has been decoded from (0 if none)
+	uint32_t x2apic_id;
+	int smt_shift;              // x2APIC id bits used by SMT threads of a core
+	int core_shift;             // x2APIC id bits used by everything below a die
+	int package_shift;          // x2APIC id bits used by everything below a package
+	int logical_per_core;
+	int logical_per_package;
+	// AMD only (-1 elsewhere)
+	int compute_unit_id;
+	int node_id;
+	int nodes_per_package;
+
+} cpuid_topology_t;
+
+void cpuid_topology(const cpuid_snapshot_t *snap, cpuid_topology_t *topology);
+
+/* One logical processor as seen by the operating system (-1 for unknown ids) */
+typedef struct
+{
+	int cpu;
+	int online;
+	int package;
+	int die;
+	int core;
+	int thread;                 // rank of this CPU among SMT siblings of its core
+	int node;                   // NUMA node
+	int l3_group;               // first CPU of the set sharing the same last level cache
+
+} logical_cpu_t;
+
+/* Cumulated time (in OS ticks) spent by a logical processor (cpu = -1 for all processors) in each state */
+typedef struct
+{
+	int cpu;
+	uint64_t user;
+	uint64_t nice;
+	uint64_t system;
+	uint64_t idle;
+	uint64_t iowait;
+	uint64_t irq;
+	uint64_t softirq;
+	uint64_t steal;
+
+} cpu_times_t;
+
+/* Percentage of time spent by a logical processor (cpu = -1 for all processors) in each state */
+typedef struct
+{
+	int cpu;
+	double user;                // includes nice
+	double system;
+	double iowait;
+	double irq;                 // includes softirq
+	double steal;
+	double idle;
+
+} cpu_load_t;
+
+/* Previous sample, so that loads are computed over the interval between two calls */
+typedef struct
+{
+	cpu_times_t *previous;
+	cpu_times_t *current;
+	int previous_count;
+	int capacity;
+
+} cpu_load_state_t;
+
+int cpu_load_sample(cpu_load_state_t *state, cpu_load_t *loads, int max);
+void cpu_load_free(cpu_load_state_t *state);
+
+#define MAX_HUGEPAGE_SIZES 4
+#define MAX_NUMA_NODES     32
+
+/* Memory usage (every size in bytes), see os_meminfo() */
+typedef struct
+{
+	uint64_t total;
+	uint64_t free;
+	uint64_t available;
+	uint64_t buffers;
+	uint64_t cached;
+	uint64_t swap_total;
+	uint64_t swap_free;
+
+	int hugepage_sizes;
+	struct
+	{
+		uint64_t size;
+		uint64_t total;         // in pages
+		uint64_t free;
+		uint64_t reserved;
+		uint64_t surplus;
+
+	} hugepages[MAX_HUGEPAGE_SIZES];
+
+	char transparent_hugepage[16]; // "always", "madvise", "never" (empty if unknown)
+
+	int nodes;
+	struct
+	{
+		int node;
+		uint64_t total;
+		uint64_t free;
+
+	} node[MAX_NUMA_NODES];
+
+} meminfo_t;
+
+/* Resources used by the current process (sizes in bytes, times in seconds) */
+typedef struct
+{
+	double user_time;
+	double system_time;
+	uint64_t virtual_size;
+	uint64_t rss;
+	uint64_t peak_rss;
+	uint64_t shared;
+	uint64_t text;
+	uint64_t data;              // data + stack
+	uint64_t swap;
+	uint64_t minor_faults;
+	uint64_t major_faults;
+	uint64_t voluntary_switches;
+	uint64_t involuntary_switches;
+	int threads;
+
+	int io;                     // TRUE if following I/O counters are available
+	uint64_t read_chars;        // bytes read/written through read()/write() and alike
+	uint64_t write_chars;
+	uint64_t read_syscalls;
+	uint64_t write_syscalls;
+	uint64_t read_bytes;        // bytes actually fetched from/sent to storage
+	uint64_t write_bytes;
+
+} process_info_t;
+
+/* Frequencies of a logical processor as reported by the operating system */
+typedef struct
+{
+	int cpu;
+	uint32_t cur_khz;
+	uint32_t min_khz;
+	uint32_t max_khz;
+
+} cpu_freq_t;
+
+/* Frequencies measured on the calling core */
+typedef struct
+{
+	double effective_mhz;   // core clock, from a chain of dependent additions (one per cycle)
+	double tsc_mhz;         // time stamp counter rate over the same interval
+
+} measured_freq_t;
+
+int measure_frequency(measured_freq_t *measured);
+
+#define TIMER_CLOCK  0   // operating system monotonic clock (ticks are nanoseconds)
+#define TIMER_RDTSC  1
+#define TIMER_RDTSCP 2
+
+/* Description of the time source behind timer_ticks() */
+typedef struct
+{
+	int source;                     // TIMER_CLOCK, TIMER_RDTSC or TIMER_RDTSCP
+	int invariant;                  // TSC runs at a constant rate whatever the power state
+	const char *frequency_source;   // "cpuid.15", "cpuid.16", "calibrated" or "clock"
+	double frequency;               // ticks per second
+	double ns_per_tick;
+	double resolution_ns;           // smallest non null difference between two readings
+	double overhead_ns;             // cost of one timer_ticks() call
+
+} timer_info_t;
+
+void timer_init(void);
+uint64_t timer_ticks(void);
+double timer_ticks_to_ns(double ticks);
+const timer_info_t *timer_get_info(void);
+
+#define BENCH_COPY    0
+#define BENCH_SCALE   1
+#define BENCH_ADD     2
+#define BENCH_TRIAD   3
+#define BENCH_KERNELS 4
+
+/* Bandwidth (in GB/s) of one STREAM kernel over all repetitions */
+typedef struct
+{
+	double min;
+	double median;
+	double max;
+
+} bench_stat_t;
+
+typedef struct
+{
+	size_t size;                    // bytes per array (0 : sized from the last level cache)
+	int repetitions;
+	int threads;                    // threads of the multi-threaded run (0 : one per physical core)
+	bench_stat_t single[BENCH_KERNELS];
+	bench_stat_t multi[BENCH_KERNELS];
+
+} bench_memory_t;
+
+int bench_memory(bench_memory_t *bench);
+
+#define MAX_LATENCY_POINTS 64
+
+/* Load-to-use latency for one working set size */
+typedef struct
+{
+	size_t size;                    // working set in bytes
+	double ns;
+	double cycles;                  // ns at the measured core clock (0 if unknown)
+
+} latency_point_t;
+
+/* Latency plateau of one cache level (level 0 is main memory) */
+typedef struct
+{
+	int level;
+	size_t cache_size;              // size of this cache level (0 for main memory)
+	size_t size;                    // working set the latency has been taken from
+	double ns;
+	double cycles;
+
+} latency_plateau_t;
+
+typedef struct
+{
+	size_t max_size;                // largest working set (0 : sized from the last level cache)
+	int line_size;                  // one node of the chain per line
+	double core_mhz;                // clock used to convert ns to cycles
+	int count;
+	latency_point_t points[MAX_LATENCY_POINTS];
+	int plateaus_count;
+	latency_plateau_t plateaus[MAX_CACHE_LEVELS + 1];
+
+} bench_latency_t;
+
+int bench_latency(bench_latency_t *bench);
+int physical_cores(void);
+int recommended_cpus(int *cpus, int max);
+
+// performance counters of the calling thread
+#define PERF_CYCLES           0
+#define PERF_INSTRUCTIONS     1
+#define PERF_CACHE_REFERENCES 2
+#define PERF_CACHE_MISSES     3
+#define PERF_BRANCH_MISSES    4
+#define PERF_TASK_CLOCK       5   // ns the thread has been running
+#define PERF_CONTEXT_SWITCHES 6
+#define PERF_COUNTERS         7
+
+#define PERF_MAX_NAME 64
+
+/* Raw counts read at once (see os_perf_read()) */
+typedef struct
+{
+	uint64_t values[PERF_COUNTERS];
+	uint32_t grouped;               // mask of the counters read from the group, which may be multiplexed
+	uint64_t time_enabled;          // ns the group has been enabled
+	uint64_t time_running;          // ns the group has actually been counting (less than enabled when multiplexed)
+
+} perf_sample_t;
+
+/* Totals accumulated between PerfBegin() and PerfEnd() of one region */
+typedef struct
+{
+	char name[PERF_MAX_NAME];
+	int depth;                      // > 0 while the region is running (regions may be nested/recursive)
+	uint32_t calls;
+	perf_sample_t start;
+	uint64_t start_ticks;
+	uint64_t totals[PERF_COUNTERS];
+	double elapsed_ns;              // wall clock time
+
+} perf_region_t;
+
+int perf_begin(const char *name);
+int perf_end(const char *name);
+const perf_region_t *perf_regions(int *count);
+uint32_t perf_counters(void);
+void perf_reset(void);
+void perf_free(void);
+
+// what the monitor samples
+#define MONITOR_CPU  (1 << 0)
+#define MONITOR_MEM  (1 << 1)
+#define MONITOR_FREQ (1 << 2)
+#define MONITOR_ALL  (MONITOR_CPU | MONITOR_MEM | MONITOR_FREQ)
+
+#define DISK_NAME_SIZE 32
+
+// most block devices DiskStats() follows
+#define MAX_DISKS 256
+
+/* One block device, as described by /sys/block under Linux */
+typedef struct
+{
+	char name[DISK_NAME_SIZE];
+	char model[64];
+	char scheduler[32];             // active I/O scheduler ("" if unknown)
+	uint64_t size;                  // bytes
+	int rotational;
+	int removable;
+	uint32_t logical_block_size;
+	uint32_t physical_block_size;
+	uint32_t queue_depth;           // commands the device queues itself (0 if unknown)
+	uint32_t nr_requests;           // requests the block layer may queue
+	uint32_t read_ahead;            // bytes
+
+} disk_info_t;
+
+/* Cumulated I/O counters of a block device, as in /proc/diskstats (sectors are always 512 bytes) */
+typedef struct
+{
+	char name[DISK_NAME_SIZE];
+	uint64_t reads;
+	uint64_t read_sectors;
+	uint64_t read_ms;
+	uint64_t writes;
+	uint64_t write_sectors;
+	uint64_t write_ms;
+	uint64_t in_flight;
+	uint64_t io_ms;                 // time spent doing I/Os
+	uint64_t queue_ms;              // time spent doing I/Os weighted by the number of I/Os in flight
+
+} disk_counters_t;
+
+/* One sample of the monitor : written by the sampler thread, read by the script thread */
+typedef struct
+{
+	volatile long sequence;     // odd while the sampler is writing it
+	double time;                // monotonic_seconds() when collected
+	uint32_t index;             // samples taken before this one
+	int what;                   // MONITOR_* actually collected
+	int cpu_count;              // cpus[0] is the total of all processors
+	cpu_load_t *cpus;
+	meminfo_t mem;
+	int freq_count;
+	cpu_freq_t *freqs;
+
+} monitor_snapshot_t;
+
+// buckets of the quantile sketch : relative accuracy of 1% from 0.001 to 10^19
+#define SKETCH_BUCKETS 2560
+
+/* Aggregates over every sample kept in a history */
+typedef struct
+{
+	volatile long sequence;     // odd while the sampler is updating them
+	uint32_t count;
+	double min;
+	double max;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+
+} history_stats_t;
+
+/* Fixed capacity ring of (time, value) samples of one metric, with aggregates maintained on each push */
+typedef struct
+{
+	uint32_t capacity;
+	volatile uint32_t written;  // samples pushed so far, the latest one is at (written - 1) % capacity
+	volatile uint32_t writing;  // written + 1 while a sample is being pushed
+	double *times;
+	double *values;
+	double sum;
+	uint32_t *max_queue;        // sample numbers whose values are decreasing (sliding maximum)
+	uint32_t max_first;
+	uint32_t max_count;
+	uint32_t *min_queue;        // sample numbers whose values are increasing (sliding minimum)
+	uint32_t min_first;
+	uint32_t min_count;
+	uint32_t zeros;             // samples <= 0, kept out of the sketch
+	uint32_t *buckets;          // logarithmic histogram of the samples > 0
+	history_stats_t stats;
+
+} history_t;
+
+int history_init(history_t *history, uint32_t capacity);
+void history_free(history_t *history);
+void history_push(history_t *history, double time, double value);
+int history_copy(const history_t *history, double since, double *times, double *values);
+int history_stats(const history_t *history, history_stats_t *stats);
+
+// metrics kept in histories by the monitor
+#define METRIC_CPU   0  // busy percentage of all processors
+#define METRIC_MEM   1  // used memory (total - available) in bytes
+#define METRIC_SWAP  2  // used swap in bytes
+#define METRIC_FREQ  3  // average current frequency in MHz
+#define METRICS      4
+
+int monitor_start(double interval, int what, double history);
+void monitor_stop(void);
+int monitor_running(void);
+const monitor_snapshot_t *monitor_latest(void);
+int monitor_history(int metric, double seconds, const double **times, const double **values, history_stats_t *stats);
+
+#define SNAPSHOT_NUMBER  0
+#define SNAPSHOT_STRING  1
+#define SNAPSHOT_BOOLEAN 2
+#define SNAPSHOT_EMPTY   3  // table holding no value, such as mem.hugepages without huge pages
+
+// deepest path ("cpu.caches.levels.0.size" is 5 deep) a snapshot may hold
+#define SNAPSHOT_MAX_DEPTH 8
+
+/* One value of a snapshot : the very same 16 bytes in memory and in a binary snapshot file */
+typedef struct
+{
+	uint32_t path;              // offset in strings of the dotted path ("sys.bios_vendor", "cpu.features.3", ...)
+	uint16_t path_length;
+	uint8_t type;               // SNAPSHOT_*
+	uint8_t reserved;
+	union
+	{
+		double number;
+		uint32_t boolean;
+		struct
+		{
+			uint32_t offset;    // in strings
+			uint32_t length;
+
+		} string;
+
+	} value;
+
+} snaprecord_t;
+
+#define SNAPSHOT_MAGIC      "SFPS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* Header of a binary snapshot file, followed by records (sorted by path) then strings */
+typedef struct
+{
+	char magic[4];              // SNAPSHOT_MAGIC
+	uint16_t version;           // SNAPSHOT_VERSION, bumped on any incompatible change
+	uint16_t header_size;       // readers skip fields added at the end by later versions
+	uint32_t byte_order;        // SNAPSHOT_BYTE_ORDER as written by the exporting host
+	uint32_t count;
+	uint32_t record_size;       // sizeof(snaprecord_t)
+	uint32_t records_offset;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+
+} snapheader_t;
+
+/* Flat list of (path, value) pairs, either built in memory or mapped from a binary snapshot file */
+typedef struct
+{
+	snaprecord_t *records;
+	uint32_t count;
+	uint32_t capacity;
+	char *strings;              // every path and string value, each followed by a NUL
+	uint32_t strings_size;
+	uint32_t strings_capacity;
+	const void *mapping;        // whole file when mapped by snapshot_map()
+	size_t mapping_size;
+
+} snapshot_t;
+
+// snapshot_map() errors
+#define SNAPSHOT_OK          0
+#define SNAPSHOT_CANT_OPEN   1
+#define SNAPSHOT_NOT_A_FILE  2   // not a binary snapshot (or truncated)
+#define SNAPSHOT_BAD_VERSION 3   // written by an incompatible version or on a host of other byte order
+
+void snapshot_init(snapshot_t *snapshot);
+void snapshot_free(snapshot_t *snapshot);
+int snapshot_number(snapshot_t *snapshot, const char *path, double value);
+int snapshot_string(snapshot_t *snapshot, const char *path, const char *value);
+int snapshot_boolean(snapshot_t *snapshot, const char *path, int value);
+int snapshot_empty(snapshot_t *snapshot, const char *path);
+void snapshot_sort(snapshot_t *snapshot);
+const char *snapshot_text(const snapshot_t *snapshot, uint32_t offset, uint32_t length);
+int snapshot_numeric(const char *segment, uint32_t length);
+int snapshot_compare_paths(const char *path1, uint32_t length1, const char *path2, uint32_t length2);
+uint32_t snapshot_find(const snapshot_t *snapshot, const char *prefix, uint32_t *first);
+int snapshot_write_json(const snapshot_t *snapshot, const char *filename);
+int snapshot_write_binary(const snapshot_t *snapshot, const char *filename);
+int snapshot_map(snapshot_t *snapshot, const char *filename);
+
+/* Receives the nested structure of sorted snapshot records from snapshot_walk() */
+typedef struct
+{
+	void (*open)(void *context, const char *key, uint32_t length, int array);
+	void (*close)(void *context, int array);
+	void (*value)(void *context, const char *key, uint32_t length, const snapshot_t *snapshot, const snaprecord_t *record);
+
+} snapshot_visitor_t;
+
+int snapshot_walk(const snapshot_t *snapshot, uint32_t first, uint32_t count, int skip, const snapshot_visitor_t *visitor, void *context);
+
+int crc32c_accelerated(void);
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
 void fill_systable(void *state);
 
+// releases whatever the OS specific part keeps open between calls
+void os_release(void);
+
+// number of logical processors the OS can handle
+int os_cpu_count(void);
+
+// fills times[0] with all processors times then one entry per online processor, returns count
+int os_cpu_times(cpu_times_t *times, int max);
+
+// fills memory usage, returns FALSE if nothing could be collected
+int os_meminfo(meminfo_t *info);
+
+// fills resources used by the current process, returns FALSE if nothing could be collected
+int os_process_info(process_info_t *info);
+
+// fills frequencies of every online processor having frequency scaling, returns count
+int os_cpu_freqs(cpu_freq_t *freqs, int max);
+
+// starts a native thread running entry(arg), returns NULL on failure
+void *os_thread_create(void (*entry)(void *arg), void *arg);
+// waits for a thread started by os_thread_create() to end
+void os_thread_join(void *thread);
+// gives the processor to another thread
+void os_yield(void);
+// suspends the calling thread
+void os_sleep(double seconds);
+
+// opens performance counters of the calling thread, returns the mask of available PERF_* counters (0 if none)
+uint32_t os_perf_open(void);
+// reads all opened counters at once (raw counts, not scaled if they have been multiplexed), returns FALSE if none
+int os_perf_read(perf_sample_t *sample);
+
+// maps a whole file read only in memory, returns NULL on failure (or if empty)
+const void *os_map_file(const char *filename, size_t *size);
+// releases a mapping made by os_map_file()
+void os_unmap_file(const void *data, size_t size);
+
+// allocates (with malloc) and fills an array of block devices, returns count
+int os_disks(disk_info_t **disks);
+
+// fills I/O counters of every block device which has been used, returns count
+int os_disk_counters(disk_counters_t *counters, int max);
+
+// number of the logical processor the calling thread is running on (-1 if unknown)
+int os_current_cpu(void);
+// fills cpus with the logical processors the calling thread may run on, returns count (0 if unknown)
+int os_get_affinity(int *cpus, int max);
+// restricts the calling thread to given logical processors, returns FALSE on failure
+int os_set_affinity(const int *cpus, int count);
+
+// fills caches as seen by the operating system for the first processor, returns count
+int os_caches(cache_level_t *caches, int max);
+
+// allocates (with malloc) and fills an array of every possible logical processor, returns count
+int os_topology(logical_cpu_t **cpus);
+
+// seconds elapsed since an arbitrary (but fixed) point in time
+double monotonic_seconds(void);
+
 #define hw_AddPart hwcl->DOSBase->hw_AddPart
 #define hw_BeginDirScan hwcl->DOSBase->hw_BeginDirScan
 #define hw_NextDirEntry hwcl->DOSBase->hw_NextDirEntry
@@ -45,3 +812,21 @@ void fill_systable(void *state);
 #define lua_pushnumber hwcl->LuaBase->lua_pushnumber
 #define lua_pushstring hwcl->LuaBase->lua_pushstring
 #define lua_rawset hwcl->LuaBase->lua_rawset
+#define lua_pushnil hwcl->LuaBase->lua_pushnil
+#define lua_type hwcl->LuaBase->lua_type
+#define lua_next hwcl->LuaBase->lua_next
+#define lua_settop hwcl->LuaBase->lua_settop
+#define lua_tostring hwcl->LuaBase->lua_tostring
+#define lua_pushlstring hwcl->LuaBase->lua_pushlstring
+#define luaL_error hwcl->LuaBase->luaL_error
+#define luaL_optnumber hwcl->LuaBase->luaL_optnumber
+#define luaL_checknumber hwcl->LuaBase->luaL_checknumber
+#define lua_rawget hwcl->LuaBase->lua_rawget
+#define lua_tonumber hwcl->LuaBase->lua_tonumber
+#define lua_toboolean hwcl->LuaBase->lua_toboolean
+#define lua_gettop hwcl->LuaBase->lua_gettop
+#define luaL_checklstring hwcl->LuaBase->luaL_checklstring
+#define luaL_optlstring hwcl->LuaBase->luaL_optlstring
+#define luaL_checktype hwcl->LuaBase->luaL_checktype
+
+#define lua_pop(L,n) lua_settop(L, -(n)-1)
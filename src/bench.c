@@ -0,0 +1,588 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// STREAM rule : each array must be at least 4 times the size of the last level cache
+#define ARRAY_CACHE_RATIO 4
+#define MIN_ARRAY_SIZE    (32 * 1024 * 1024)
+#define MAX_ARRAY_SIZE    ((size_t)512 * 1024 * 1024)
+
+// latency probe : working sets from 4 KiB to 4 times the last level cache (at least 64 MiB)
+#define MIN_WORKING_SET       (4 * 1024)
+#define MIN_LATENCY_MAX_SIZE  (64 * 1024 * 1024)
+#define MAX_LATENCY_MAX_SIZE  ((size_t)512 * 1024 * 1024)
+#define DEFAULT_LINE_SIZE     64
+#define LATENCY_HOPS          (1 << 19)
+#define LATENCY_PASSES        3
+
+#define DEFAULT_REPETITIONS 5
+#define MAX_REPETITIONS     100
+
+// spins before giving the processor away while waiting at the barrier
+#define SPINS_BEFORE_YIELD 4096
+
+// bytes moved per element by each kernel
+static const int KernelBytes[BENCH_KERNELS] =
+{
+	2 * sizeof(double),     // copy  : c = a
+	2 * sizeof(double),     // scale : b = s * c
+	3 * sizeof(double),     // add   : c = a + b
+	3 * sizeof(double)      // triad : a = b + s * c
+};
+
+typedef struct
+{
+	volatile long count;
+	volatile long generation;
+	long parties;
+
+} spin_barrier_t;
+
+/* Shared by all threads of a run */
+typedef struct
+{
+	double *a;
+	double *b;
+	double *c;
+	size_t elements;
+	int threads;
+	int repetitions;
+	volatile int go;        // 0 : wait, 1 : run, -1 : abort (a thread couldn't be started)
+	spin_barrier_t barrier;
+	double *start;          // [repetition][kernel][thread]
+	double *end;
+
+} stream_t;
+
+typedef struct
+{
+	stream_t *stream;
+	int index;
+	int cpu;                // logical processor the worker is pinned on (-1 : not pinned)
+
+} worker_t;
+
+static void barrier_wait(spin_barrier_t *barrier)
+{
+	long generation = barrier->generation;
+	int spins = 0;
+
+	if (atomic_increment(&barrier->count) == barrier->parties)
+	{
+		barrier->count = 0;
+		memory_barrier();
+		barrier->generation = generation + 1;
+		return;
+	}
+
+	while (barrier->generation == generation)
+	{
+		_mm_pause();
+
+		if (++spins == SPINS_BEFORE_YIELD)
+		{
+			spins = 0;
+			os_yield();
+		}
+	}
+}
+
+static void run_kernel(int kernel, double *a, double *b, double *c, size_t count)
+{
+	const double scalar = 3.0;
+	size_t i = 0;
+
+	switch (kernel)
+	{
+	case BENCH_COPY:
+		for (i = 0; i < count; ++i) c[i] = a[i];
+		break;
+	case BENCH_SCALE:
+		for (i = 0; i < count; ++i) b[i] = scalar * c[i];
+		break;
+	case BENCH_ADD:
+		for (i = 0; i < count; ++i) c[i] = a[i] + b[i];
+		break;
+	case BENCH_TRIAD:
+		for (i = 0; i < count; ++i) a[i] = b[i] + scalar * c[i];
+		break;
+	}
+}
+
+static void stream_worker(void *arg)
+{
+	worker_t *worker = (worker_t *)arg;
+	stream_t *stream = worker->stream;
+	size_t slice = stream->elements / stream->threads;
+	size_t first = slice * worker->index;
+	size_t count = (worker->index == stream->threads - 1) ? stream->elements - first : slice;
+	size_t i = 0;
+	int repetition = 0;
+	int kernel = 0;
+
+	while (stream->go == 0)
+	{
+		os_yield();
+	}
+
+	if (stream->go < 0)
+	{
+		return;
+	}
+
+	// before touching anything : the scheduler can't move the thread away from its pages afterwards
+	if (worker->cpu >= 0)
+	{
+		os_set_affinity(&worker->cpu, 1);
+	}
+
+	// first touch (arrays are allocated for each run) : pages end up on the NUMA node of the thread using them
+	for (i = first; i < first + count; ++i)
+	{
+		stream->a[i] = 1.0;
+		stream->b[i] = 2.0;
+		stream->c[i] = 0.0;
+	}
+
+	for (repetition = 0; repetition < stream->repetitions; ++repetition)
+	{
+		for (kernel = 0; kernel < BENCH_KERNELS; ++kernel)
+		{
+			size_t slot = ((size_t)repetition * BENCH_KERNELS + kernel) * stream->threads + worker->index;
+
+			barrier_wait(&stream->barrier);
+
+			stream->start[slot] = monotonic_seconds();
+			run_kernel(kernel, stream->a + first, stream->b + first, stream->c + first, count);
+			stream->end[slot] = monotonic_seconds();
+		}
+	}
+}
+
+static int compare_double(const void *arg1, const void *arg2)
+{
+	double value1 = *(const double *)arg1;
+	double value2 = *(const double *)arg2;
+
+	return (value1 > value2) - (value1 < value2);
+}
+
+/* Runs every kernel repetitions times with given number of threads and fills stats
+** Arrays are allocated for each run so that every run touches its pages first */
+static int run_stream(stream_t *stream, int threads, bench_stat_t *stats)
+{
+	size_t slots = (size_t)stream->repetitions * BENCH_KERNELS * threads;
+	worker_t *workers = calloc(threads, sizeof(worker_t));
+	void **handles = calloc(threads, sizeof(void *));
+	int *cpus = calloc(threads, sizeof(int));
+	double *bandwidths = calloc(stream->repetitions, sizeof(double));
+	int pinned = 0;
+	int started = 0;
+	int kernel = 0;
+	int i = 0;
+
+	stream->threads = threads;
+	stream->go = 0;
+	stream->a = malloc(stream->elements * sizeof(double));
+	stream->b = malloc(stream->elements * sizeof(double));
+	stream->c = malloc(stream->elements * sizeof(double));
+	stream->start = calloc(slots, sizeof(double));
+	stream->end = calloc(slots, sizeof(double));
+	memset((void *)&stream->barrier, 0, sizeof(stream->barrier));
+	stream->barrier.parties = threads;
+
+	if (workers == NULL || handles == NULL || cpus == NULL || bandwidths == NULL || stream->start == NULL || stream->end == NULL ||
+		stream->a == NULL || stream->b == NULL || stream->c == NULL)
+	{
+		threads = 0;
+	}
+
+	// the single threaded run stays in the calling thread, whose affinity is left alone
+	if (threads > 1)
+	{
+		pinned = recommended_cpus(cpus, threads);
+	}
+
+	for (i = 0; i < threads; ++i)
+	{
+		workers[i].stream = stream;
+		workers[i].index = i;
+		workers[i].cpu = (i < pinned) ? cpus[i] : -1;
+
+		// single threaded run stays in the calling thread
+		if (threads > 1)
+		{
+			handles[i] = os_thread_create(stream_worker, &workers[i]);
+
+			if (handles[i] == NULL)
+			{
+				break;
+			}
+
+			++started;
+		}
+	}
+
+	memory_barrier();
+	stream->go = (threads == 1 || started == threads) ? 1 : -1;
+
+	if (threads == 1)
+	{
+		stream_worker(&workers[0]);
+	}
+
+	for (i = 0; i < started; ++i)
+	{
+		os_thread_join(handles[i]);
+	}
+
+	if (threads > 0 && (threads == 1 || started == threads))
+	{
+		for (kernel = 0; kernel < BENCH_KERNELS; ++kernel)
+		{
+			int repetition = 0;
+
+			for (repetition = 0; repetition < stream->repetitions; ++repetition)
+			{
+				size_t slot = ((size_t)repetition * BENCH_KERNELS + kernel) * threads;
+				double first = stream->start[slot];
+				double last = stream->end[slot];
+
+				for (i = 1; i < threads; ++i)
+				{
+					if (stream->start[slot + i] < first) first = stream->start[slot + i];
+					if (stream->end[slot + i] > last) last = stream->end[slot + i];
+				}
+
+				bandwidths[repetition] = (last > first) ? (double)KernelBytes[kernel] * stream->elements / (last - first) / 1e9 : 0.0;
+			}
+
+			qsort(bandwidths, stream->repetitions, sizeof(double), compare_double);
+
+			stats[kernel].min = bandwidths[0];
+			stats[kernel].max = bandwidths[stream->repetitions - 1];
+			stats[kernel].median = (stream->repetitions & 1) ? bandwidths[stream->repetitions / 2] :
+				(bandwidths[stream->repetitions / 2 - 1] + bandwidths[stream->repetitions / 2]) / 2.0;
+		}
+	}
+
+	free(stream->a);
+	free(stream->b);
+	free(stream->c);
+	free(stream->start);
+	free(stream->end);
+	free(bandwidths);
+	free(cpus);
+	free(handles);
+	free(workers);
+
+	return threads > 0 && (threads == 1 || started == threads);
+}
+
+/* Returns the size of the largest cache, 0 if unknown */
+static size_t last_level_cache(void)
+{
+	cache_level_t caches[MAX_CACHE_LEVELS];
+	int count = cache_hierarchy(caches, MAX_CACHE_LEVELS);
+	size_t largest = 0;
+	int i = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (caches[i].size > largest)
+		{
+			largest = caches[i].size;
+		}
+	}
+
+	return largest;
+}
+
+/* STREAM-like memory bandwidth benchmark : copy, scale, add and triad kernels are run over three
+** arrays much larger than the last level cache, first in calling thread then in several threads */
+int bench_memory(bench_memory_t *bench)
+{
+	stream_t stream;
+	meminfo_t mem;
+	int ok = FALSE;
+
+	memset(&stream, 0, sizeof(stream));
+	memset(bench->single, 0, sizeof(bench->single));
+	memset(bench->multi, 0, sizeof(bench->multi));
+
+	if (bench->size == 0)
+	{
+		bench->size = ARRAY_CACHE_RATIO * last_level_cache();
+
+		if (bench->size < MIN_ARRAY_SIZE) bench->size = MIN_ARRAY_SIZE;
+		if (bench->size > MAX_ARRAY_SIZE) bench->size = MAX_ARRAY_SIZE;
+
+		// never take more than half of available memory
+		if (os_meminfo(&mem) && mem.available > 0 && 3 * bench->size > mem.available / 2)
+		{
+			bench->size = (size_t)(mem.available / 6);
+		}
+	}
+
+	if (bench->repetitions <= 0) bench->repetitions = DEFAULT_REPETITIONS;
+	if (bench->repetitions > MAX_REPETITIONS) bench->repetitions = MAX_REPETITIONS;
+	if (bench->threads <= 0) bench->threads = physical_cores();
+	if (bench->threads > os_cpu_count()) bench->threads = os_cpu_count();
+
+	stream.elements = bench->size / sizeof(double);
+	stream.repetitions = bench->repetitions;
+
+	if (stream.elements >= (size_t)bench->threads)
+	{
+		ok = run_stream(&stream, 1, bench->single);
+
+		if (ok && bench->threads > 1)
+		{
+			ok = run_stream(&stream, bench->threads, bench->multi);
+		}
+		else if (ok)
+		{
+			memcpy(bench->multi, bench->single, sizeof(bench->multi));
+		}
+	}
+
+	return ok;
+}
+
+/* xorshift64 : fast and good enough to shuffle a chain */
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return *state = x;
+}
+
+/* Links the lines of the working set into a single random cycle (Sattolo's algorithm), so that
+** consecutive loads hit unrelated pages and neither stride nor page prefetchers can help */
+static void **build_chain(char *buffer, size_t size, int line_size, size_t *order)
+{
+	size_t nodes = size / line_size;
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	size_t i = 0;
+
+	for (i = 0; i < nodes; ++i)
+	{
+		order[i] = i;
+	}
+
+	for (i = nodes - 1; i > 0; --i)
+	{
+		size_t j = (size_t)(next_random(&state) % i);
+		size_t swap = order[i];
+
+		order[i] = order[j];
+		order[j] = swap;
+	}
+
+	// order[] is now a permutation with a single cycle : line i points to line order[i]
+	for (i = 0; i < nodes; ++i)
+	{
+		*(void **)(buffer + i * line_size) = buffer + order[i] * line_size;
+	}
+
+	return (void **)buffer;
+}
+
+static void ** volatile latency_sink;
+
+/* Follows the chain for hops loads, each one depending on the previous one */
+static void **chase(void **p, size_t hops)
+{
+	size_t i = 0;
+
+	for (i = 0; i < hops; i += 8)
+	{
+		p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+		p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+	}
+
+	return p;
+}
+
+/* Returns the smallest average time of one load (in ns) over several passes */
+static double measure_latency(void **chain, size_t nodes)
+{
+	double best = 0.0;
+	int pass = 0;
+
+	// warm up caches and TLB with one full turn (bounded for very large working sets)
+	chain = chase(chain, (nodes < LATENCY_HOPS) ? (nodes + 7) & ~(size_t)7 : LATENCY_HOPS);
+
+	for (pass = 0; pass < LATENCY_PASSES; ++pass)
+	{
+		uint64_t start = timer_ticks();
+		double ns = 0.0;
+
+		chain = chase(chain, LATENCY_HOPS);
+		ns = timer_ticks_to_ns((double)(timer_ticks() - start)) / LATENCY_HOPS;
+
+		if (pass == 0 || ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	// keeps the compiler from dropping the chase
+	latency_sink = chain;
+
+	return best;
+}
+
+/* Picks for each data cache level the latency of the largest working set that fits comfortably
+** in it (half its size) without fitting in the previous level, and main memory from the largest one */
+static void find_plateaus(bench_latency_t *bench, const cache_level_t *caches, int count)
+{
+	size_t previous = 0;
+	int i = 0;
+	int j = 0;
+
+	bench->plateaus_count = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		latency_plateau_t *plateau = &bench->plateaus[bench->plateaus_count];
+		size_t size = caches[i].os_size ? caches[i].os_size : caches[i].size;
+		int best = -1;
+
+		if (caches[i].type == CACHE_INSTRUCTION || size <= previous)
+		{
+			continue;
+		}
+
+		for (j = 0; j < bench->count; ++j)
+		{
+			if (bench->points[j].size > previous && bench->points[j].size <= size / 2)
+			{
+				best = j;
+			}
+		}
+
+		if (best >= 0)
+		{
+			plateau->level = caches[i].level;
+			plateau->cache_size = size;
+			plateau->size = bench->points[best].size;
+			plateau->ns = bench->points[best].ns;
+			plateau->cycles = bench->points[best].cycles;
+			++bench->plateaus_count;
+		}
+
+		previous = size;
+	}
+
+	if (bench->count > 0 && bench->points[bench->count - 1].size >= 2 * previous)
+	{
+		latency_plateau_t *plateau = &bench->plateaus[bench->plateaus_count++];
+
+		plateau->level = 0;
+		plateau->cache_size = 0;
+		plateau->size = bench->points[bench->count - 1].size;
+		plateau->ns = bench->points[bench->count - 1].ns;
+		plateau->cycles = bench->points[bench->count - 1].cycles;
+	}
+}
+
+/* Pointer chasing latency probe : for working sets growing from 4 KiB (by steps of x1.5 and x4/3)
+** to several times the last level cache, measures the average time of one dependent load */
+int bench_latency(bench_latency_t *bench)
+{
+	cache_level_t caches[MAX_CACHE_LEVELS];
+	int caches_count = cache_hierarchy(caches, MAX_CACHE_LEVELS);
+	measured_freq_t freq;
+	meminfo_t mem;
+	char *buffer = NULL;
+	size_t *order = NULL;
+	size_t size = MIN_WORKING_SET;
+
+	bench->count = 0;
+	bench->plateaus_count = 0;
+	bench->line_size = (caches_count > 0 && caches[0].line_size > 0) ? caches[0].line_size : DEFAULT_LINE_SIZE;
+	bench->core_mhz = measure_frequency(&freq) ? freq.effective_mhz : 0.0;
+
+	if (bench->max_size == 0)
+	{
+		bench->max_size = ARRAY_CACHE_RATIO * last_level_cache();
+
+		if (bench->max_size < MIN_LATENCY_MAX_SIZE) bench->max_size = MIN_LATENCY_MAX_SIZE;
+		if (bench->max_size > MAX_LATENCY_MAX_SIZE) bench->max_size = MAX_LATENCY_MAX_SIZE;
+
+		// buffer plus shuffling order must stay well below available memory
+		while (os_meminfo(&mem) && mem.available > 0 && bench->max_size > MIN_WORKING_SET && 2 * bench->max_size > mem.available / 2)
+		{
+			bench->max_size /= 2;
+		}
+	}
+
+	if (bench->max_size < MIN_WORKING_SET)
+	{
+		bench->max_size = MIN_WORKING_SET;
+	}
+
+	buffer = malloc(bench->max_size);
+	order = malloc(bench->max_size / bench->line_size * sizeof(size_t));
+
+	if (buffer == NULL || order == NULL)
+	{
+		free(buffer);
+		free(order);
+		return FALSE;
+	}
+
+	// calibrated now rather than during the first measure (no-op if Ticks() was already used)
+	timer_get_info();
+
+	while (size <= bench->max_size && bench->count < MAX_LATENCY_POINTS)
+	{
+		latency_point_t *point = &bench->points[bench->count++];
+		void **chain = build_chain(buffer, size, bench->line_size, order);
+
+		point->size = size;
+		point->ns = measure_latency(chain, size / bench->line_size);
+		point->cycles = point->ns * bench->core_mhz / 1000.0;
+
+		// 4, 6, 8, 12, 16, 24 ... KiB
+		size = ((size & (size - 1)) == 0) ? size + size / 2 : size + size / 3;
+	}
+
+	find_plateaus(bench, caches, caches_count);
+
+	free(buffer);
+	free(order);
+
+	return TRUE;
+}
@@ -0,0 +1,135 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// CRC32 with the Castagnoli polynomial (reversed), the one computed by the SSE4.2 CRC32 instruction
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+// the instruction can be used by this function even if the rest of the plugin is compiled for older processors
+#if MSVC_COMPILER
+#  define TARGET_SSE4_2
+#else
+#  define TARGET_SSE4_2 __attribute__((target("sse4.2")))
+#endif
+
+static uint32_t CrcTable[256];
+static int crc_table_ready = FALSE;
+
+static void crc_table_init(void)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		int bit = 0;
+
+		for (bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+		}
+
+		CrcTable[i] = crc;
+	}
+
+	crc_table_ready = TRUE;
+}
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *data, size_t size)
+{
+	if (!crc_table_ready)
+	{
+		crc_table_init();
+	}
+
+	while (size-- > 0)
+	{
+		crc = CrcTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+static TARGET_SSE4_2 uint32_t crc32c_sse4_2(uint32_t crc, const uint8_t *data, size_t size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	uint64_t crc64 = crc;
+
+	while (size >= sizeof(uint64_t))
+	{
+		uint64_t value = 0;
+
+		memcpy(&value, data, sizeof(value));
+		crc64 = _mm_crc32_u64(crc64, value);
+		data += sizeof(value);
+		size -= sizeof(value);
+	}
+
+	crc = (uint32_t)crc64;
+#endif
+
+	while (size >= sizeof(uint32_t))
+	{
+		uint32_t value = 0;
+
+		memcpy(&value, data, sizeof(value));
+		crc = _mm_crc32_u32(crc, value);
+		data += sizeof(value);
+		size -= sizeof(value);
+	}
+
+	while (size-- > 0)
+	{
+		crc = _mm_crc32_u8(crc, *data++);
+	}
+
+	return crc;
+}
+
+/* TRUE if crc32c() uses the CRC32 instruction (both ways give the same results) */
+int crc32c_accelerated(void)
+{
+	return feature_test(feature_set(), FEATURE_SSE4_2);
+}
+
+/* Continues crc (0 for the first block) with size bytes of data */
+uint32_t crc32c(uint32_t crc, const void *data, size_t size)
+{
+	crc = ~crc;
+
+	if (crc32c_accelerated())
+	{
+		crc = crc32c_sse4_2(crc, (const uint8_t *)data, size);
+	}
+	else
+	{
+		crc = crc32c_software(crc, (const uint8_t *)data, size);
+	}
+
+	return ~crc;
+}
@@ -0,0 +1,291 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// sketch buckets grow by 2% : a quantile is within 1% of an actual sample
+#define SKETCH_GAMMA  1.02
+// bucket of 1.0, so that values down to 1.02^-350 (about 0.001) keep their accuracy
+#define SKETCH_OFFSET 350
+
+static int sketch_bucket(double value)
+{
+	int bucket = (int)ceil(log(value) / log(SKETCH_GAMMA)) + SKETCH_OFFSET;
+
+	if (bucket < 0) return 0;
+	if (bucket >= SKETCH_BUCKETS) return SKETCH_BUCKETS - 1;
+
+	return bucket;
+}
+
+/* Middle of the values falling into given bucket */
+static double sketch_value(int bucket)
+{
+	return 2.0 * pow(SKETCH_GAMMA, bucket - SKETCH_OFFSET) / (SKETCH_GAMMA + 1.0);
+}
+
+static void sketch_add(history_t *history, double value, int delta)
+{
+	if (value <= 0.0)
+	{
+		history->zeros += delta;
+	}
+	else
+	{
+		history->buckets[sketch_bucket(value)] += delta;
+	}
+}
+
+/* Returns the value below which lies given fraction of the samples (count must not be 0) */
+static double sketch_quantile(const history_t *history, uint32_t count, double fraction)
+{
+	uint32_t rank = (uint32_t)(fraction * (count - 1));
+	uint32_t seen = history->zeros;
+	int bucket = 0;
+
+	if (rank < seen)
+	{
+		return 0.0;
+	}
+
+	for (bucket = 0; bucket < SKETCH_BUCKETS; ++bucket)
+	{
+		seen += history->buckets[bucket];
+
+		if (rank < seen)
+		{
+			return sketch_value(bucket);
+		}
+	}
+
+	return history->stats.max;
+}
+
+int history_init(history_t *history, uint32_t capacity)
+{
+	memset(history, 0, sizeof(*history));
+
+	history->capacity = capacity;
+	history->times = malloc(capacity * sizeof(double));
+	history->values = malloc(capacity * sizeof(double));
+	history->max_queue = malloc(capacity * sizeof(uint32_t));
+	history->min_queue = malloc(capacity * sizeof(uint32_t));
+	history->buckets = calloc(SKETCH_BUCKETS, sizeof(uint32_t));
+
+	if (history->times == NULL || history->values == NULL || history->max_queue == NULL || history->min_queue == NULL || history->buckets == NULL)
+	{
+		history_free(history);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void history_free(history_t *history)
+{
+	free(history->times);
+	free(history->values);
+	free(history->max_queue);
+	free(history->min_queue);
+	free(history->buckets);
+	memset(history, 0, sizeof(*history));
+}
+
+#define QUEUE_AT(history, queue, first, i) (history)->queue[((history)->first + (i)) % (history)->capacity]
+#define VALUE_OF(history, sample) (history)->values[(sample) % (history)->capacity]
+
+/* Only called by the sampler thread : adds a sample (evicting the oldest one once full) and updates aggregates */
+void history_push(history_t *history, double time, double value)
+{
+	uint32_t sample = history->written;
+	uint32_t slot = sample % history->capacity;
+	uint32_t count = 0;
+
+	// readers must not trust the slot about to be overwritten from now on
+	history->writing = sample + 1;
+	memory_barrier();
+
+	// evict the sample about to be overwritten
+	if (sample >= history->capacity)
+	{
+		double evicted = history->values[slot];
+
+		history->sum -= evicted;
+		sketch_add(history, evicted, -1);
+
+		if (history->max_count > 0 && history->max_queue[history->max_first] == sample - history->capacity)
+		{
+			history->max_first = (history->max_first + 1) % history->capacity;
+			--history->max_count;
+		}
+
+		if (history->min_count > 0 && history->min_queue[history->min_first] == sample - history->capacity)
+		{
+			history->min_first = (history->min_first + 1) % history->capacity;
+			--history->min_count;
+		}
+	}
+
+	history->times[slot] = time;
+	history->values[slot] = value;
+
+	// sliding maximum/minimum : drop queued samples which can't be the extremum anymore
+	while (history->max_count > 0 && VALUE_OF(history, QUEUE_AT(history, max_queue, max_first, history->max_count - 1)) <= value)
+	{
+		--history->max_count;
+	}
+
+	QUEUE_AT(history, max_queue, max_first, history->max_count) = sample;
+	++history->max_count;
+
+	while (history->min_count > 0 && VALUE_OF(history, QUEUE_AT(history, min_queue, min_first, history->min_count - 1)) >= value)
+	{
+		--history->min_count;
+	}
+
+	QUEUE_AT(history, min_queue, min_first, history->min_count) = sample;
+	++history->min_count;
+
+	sketch_add(history, value, 1);
+
+	// once per turn of the ring, sum is computed again to get rid of accumulated rounding errors
+	if (slot == history->capacity - 1)
+	{
+		uint32_t i = 0;
+
+		history->sum = 0.0;
+
+		for (i = 0; i < history->capacity; ++i)
+		{
+			history->sum += history->values[i];
+		}
+	}
+	else
+	{
+		history->sum += value;
+	}
+
+	count = (sample + 1 < history->capacity) ? sample + 1 : history->capacity;
+
+	memory_barrier();
+	history->written = sample + 1;
+
+	// aggregates are published like monitor snapshots : sequence is odd while they change
+	atomic_increment(&history->stats.sequence);
+	memory_barrier();
+
+	history->stats.count = count;
+	history->stats.max = VALUE_OF(history, history->max_queue[history->max_first]);
+	history->stats.min = VALUE_OF(history, history->min_queue[history->min_first]);
+	history->stats.mean = history->sum / count;
+	history->stats.p50 = sketch_quantile(history, count, 0.50);
+	history->stats.p95 = sketch_quantile(history, count, 0.95);
+	history->stats.p99 = sketch_quantile(history, count, 0.99);
+
+	memory_barrier();
+	atomic_increment(&history->stats.sequence);
+}
+
+/* Copies samples taken at or after since (oldest first) into times and values (capacity entries each)
+** Returns how many have been copied : samples overwritten by the sampler while copying are left out */
+int history_copy(const history_t *history, double since, double *times, double *values)
+{
+	uint32_t written = history->written;
+	uint32_t oldest = (written > history->capacity) ? written - history->capacity : 0;
+	uint32_t sample = written;
+	uint32_t count = 0;
+	uint32_t first = 0;
+
+	memory_barrier();
+
+	// newest first, into the end of the arrays
+	while (sample > oldest)
+	{
+		uint32_t slot = (sample - 1) % history->capacity;
+
+		if (history->times[slot] < since)
+		{
+			break;
+		}
+
+		--sample;
+		++count;
+		times[history->capacity - count] = history->times[slot];
+		values[history->capacity - count] = history->values[slot];
+	}
+
+	memory_barrier();
+
+	// samples whose slot has been (or is being) reused meanwhile can't be trusted
+	written = history->writing;
+	first = (written > history->capacity) ? written - history->capacity : 0;
+
+	if (sample < first)
+	{
+		count -= (first - sample < count) ? first - sample : count;
+	}
+
+	memmove(times, times + history->capacity - count, count * sizeof(double));
+	memmove(values, values + history->capacity - count, count * sizeof(double));
+
+	return (int)count;
+}
+
+/* Copies latest aggregates, returns FALSE (and zeroes stats) if the sampler kept updating them meanwhile */
+int history_stats(const history_t *history, history_stats_t *stats)
+{
+	int attempt = 0;
+
+	for (attempt = 0; attempt < 4; ++attempt)
+	{
+		long sequence = history->stats.sequence;
+
+		memory_barrier();
+
+		if (sequence & 1)
+		{
+			continue;
+		}
+
+		*stats = history->stats;
+
+		memory_barrier();
+
+		if (history->stats.sequence == sequence)
+		{
+			return TRUE;
+		}
+	}
+
+	// the copy may mix two updates
+	memset(stats, 0, sizeof(*stats));
+
+	return FALSE;
+}
@@ -0,0 +1,146 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+/* What a helper thread gets to identify one processor */
+typedef struct
+{
+	cpu_identity_t *identity;
+	cpuid_snapshot_t *snap;     // scratch, helpers run one after the other
+
+} identify_job_t;
+
+static void identify(void *arg)
+{
+	identify_job_t *job = (identify_job_t *)arg;
+	cpu_identity_t *identity = job->identity;
+	const uint32_t *leaf = NULL;
+	int cpu = identity->cpu;
+
+	identity->pinned = os_set_affinity(&cpu, 1) && os_current_cpu() == cpu;
+
+	cpuid_capture_cpu(job->snap);
+
+	leaf = cpuid_leaf(job->snap, 1, 0);
+	identity->signature = (leaf != NULL) ? leaf[CPUID_EAX] : 0;
+
+	leaf = cpuid_leaf(job->snap, 0x1A, 0);
+
+	if (leaf != NULL)
+	{
+		identity->core_type = leaf[CPUID_EAX] >> 24;
+		identity->native_model = leaf[CPUID_EAX] & 0xFFFFFF;
+	}
+
+	identity->cache_count = cpuid_caches(job->snap, identity->caches, MAX_CACHE_LEVELS);
+	feature_set_capture(job->snap, &identity->features);
+}
+
+/* Allocates and fills an array of every online logical processor (those the calling thread may run on if topology
+** is unknown), returns count */
+static int online_cpus(int **cpus)
+{
+	logical_cpu_t *topology = NULL;
+	int count = os_topology(&topology);
+	int possible = (count > os_cpu_count()) ? count : os_cpu_count();
+	int online = 0;
+	int i = 0;
+
+	*cpus = malloc((possible + 1) * sizeof(int));
+
+	if (*cpus != NULL)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			if (topology[i].online)
+			{
+				(*cpus)[online++] = topology[i].cpu;
+			}
+		}
+
+		if (online == 0)
+		{
+			online = os_get_affinity(*cpus, possible);
+		}
+	}
+
+	free(topology);
+
+	return online;
+}
+
+/* Runs CPUID on every online logical processor, even outside the affinity of the calling thread, from a short-lived
+** thread pinned on each one in turn (the calling thread keeps its affinity), allocates and fills identities,
+** returns count */
+int cpu_identities(cpu_identity_t **identities)
+{
+	int *cpus = NULL;
+	cpuid_snapshot_t *snap = malloc(sizeof(cpuid_snapshot_t));
+	identify_job_t job;
+	int count = 0;
+	int done = 0;
+
+	*identities = NULL;
+
+	if (snap != NULL)
+	{
+		count = online_cpus(&cpus);
+	}
+
+	if (cpus != NULL)
+	{
+		*identities = calloc(count + 1, sizeof(cpu_identity_t));
+	}
+
+	if (*identities != NULL)
+	{
+		for (done = 0; done < count; ++done)
+		{
+			void *thread = NULL;
+
+			job.identity = &(*identities)[done];
+			job.identity->cpu = cpus[done];
+			job.snap = snap;
+
+			thread = os_thread_create(identify, &job);
+
+			if (thread == NULL)
+			{
+				break;
+			}
+
+			os_thread_join(thread);
+		}
+	}
+
+	free(cpus);
+	free(snap);
+
+	return done;
+}
@@ -0,0 +1,350 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// the sampler sleeps by slices so that monitor_stop() never waits long
+#define SLEEP_SLICE 0.01
+
+// GetLatest() gives up copying after this many samples published while it was copying
+#define MAX_COPY_ATTEMPTS 4
+
+static monitor_snapshot_t buffers[2];
+static monitor_snapshot_t readers[2];   // copies handed to the script thread : last good one and scratch
+static int reader = 0;
+static volatile long published = -1;    // buffer holding the latest complete sample (-1 : none yet)
+static volatile int stop = FALSE;
+static void *sampler = NULL;
+static double period = 1.0;
+static int sampled = 0;
+static int cpus_capacity = 0;
+static int freqs_capacity = 0;
+static cpu_load_state_t load_state;
+static history_t histories[METRICS];
+static double *history_times = NULL;     // scratch for monitor_history() (one history capacity each)
+static double *history_values = NULL;
+static history_stats_t history_last[METRICS];   // last consistent aggregates handed to the script thread
+
+// histories keep at most this many samples per metric
+#define MAX_HISTORY_SAMPLES 65536
+
+static int alloc_snapshot(monitor_snapshot_t *snapshot)
+{
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	snapshot->cpus = calloc(cpus_capacity, sizeof(cpu_load_t));
+	snapshot->freqs = calloc(freqs_capacity, sizeof(cpu_freq_t));
+
+	return snapshot->cpus != NULL && snapshot->freqs != NULL;
+}
+
+static void free_snapshot(monitor_snapshot_t *snapshot)
+{
+	free(snapshot->cpus);
+	free(snapshot->freqs);
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+static void collect(monitor_snapshot_t *snapshot, uint32_t index)
+{
+	snapshot->index = index;
+	snapshot->what = 0;
+	snapshot->cpu_count = 0;
+	snapshot->freq_count = 0;
+
+	if (sampled & MONITOR_CPU)
+	{
+		snapshot->cpu_count = cpu_load_sample(&load_state, snapshot->cpus, cpus_capacity);
+		if (snapshot->cpu_count > 0) snapshot->what |= MONITOR_CPU;
+	}
+
+	if ((sampled & MONITOR_MEM) && os_meminfo(&snapshot->mem))
+	{
+		snapshot->what |= MONITOR_MEM;
+	}
+
+	if (sampled & MONITOR_FREQ)
+	{
+		snapshot->freq_count = os_cpu_freqs(snapshot->freqs, freqs_capacity);
+		if (snapshot->freq_count > 0) snapshot->what |= MONITOR_FREQ;
+	}
+
+	snapshot->time = monotonic_seconds();
+}
+
+/* Pushes metrics of a new snapshot into their histories */
+static void record(const monitor_snapshot_t *snapshot)
+{
+	if (snapshot->what & MONITOR_CPU)
+	{
+		history_push(&histories[METRIC_CPU], snapshot->time, 100.0 - snapshot->cpus[0].idle - snapshot->cpus[0].iowait);
+	}
+
+	if (snapshot->what & MONITOR_MEM)
+	{
+		history_push(&histories[METRIC_MEM], snapshot->time, (double)(snapshot->mem.total - snapshot->mem.available));
+		history_push(&histories[METRIC_SWAP], snapshot->time, (double)(snapshot->mem.swap_total - snapshot->mem.swap_free));
+	}
+
+	if (snapshot->what & MONITOR_FREQ)
+	{
+		double sum = 0.0;
+		int i = 0;
+
+		for (i = 0; i < snapshot->freq_count; ++i)
+		{
+			sum += snapshot->freqs[i].cur_khz / 1000.0;
+		}
+
+		history_push(&histories[METRIC_FREQ], snapshot->time, sum / snapshot->freq_count);
+	}
+}
+
+/* Sampler thread : fills the buffer which isn't published, then publishes it */
+static void sample_loop(void *arg)
+{
+	double next = monotonic_seconds();
+	uint32_t index = 0;
+
+	while (stop == FALSE)
+	{
+		long target = (published == 0) ? 1 : 0;
+		monitor_snapshot_t *snapshot = &buffers[target];
+		double now = 0.0;
+
+		atomic_increment(&snapshot->sequence);
+		memory_barrier();
+
+		collect(snapshot, index++);
+
+		memory_barrier();
+		atomic_increment(&snapshot->sequence);
+
+		atomic_exchange(&published, target);
+
+		record(snapshot);
+
+		next += period;
+		now = monotonic_seconds();
+
+		// collecting took longer than the interval : don't try to catch up
+		if (next < now)
+		{
+			next = now;
+		}
+
+		while (stop == FALSE && now < next)
+		{
+			os_sleep((next - now < SLEEP_SLICE) ? next - now : SLEEP_SLICE);
+			now = monotonic_seconds();
+		}
+	}
+}
+
+/* Starts sampling what (MONITOR_*) every interval seconds in a native thread, keeping the last
+** history seconds of each metric, restarts it if already running */
+int monitor_start(double interval, int what, double history)
+{
+	double samples = ceil(history / interval);
+	uint32_t capacity = (samples < 2.0) ? 2 : (samples > MAX_HISTORY_SAMPLES) ? MAX_HISTORY_SAMPLES : (uint32_t)samples;
+	int i = 0;
+
+	monitor_stop();
+
+	cpus_capacity = os_cpu_count() + 1;
+	freqs_capacity = os_cpu_count();
+
+	if (!alloc_snapshot(&buffers[0]) || !alloc_snapshot(&buffers[1]) || !alloc_snapshot(&readers[0]) || !alloc_snapshot(&readers[1]))
+	{
+		monitor_stop();
+		return FALSE;
+	}
+
+	history_times = malloc(capacity * sizeof(double));
+	history_values = malloc(capacity * sizeof(double));
+
+	for (i = 0; i < METRICS; ++i)
+	{
+		if (history_init(&histories[i], capacity) == FALSE)
+		{
+			monitor_stop();
+			return FALSE;
+		}
+
+		memset(&history_last[i], 0, sizeof(history_last[i]));
+	}
+
+	if (history_times == NULL || history_values == NULL)
+	{
+		monitor_stop();
+		return FALSE;
+	}
+
+	period = interval;
+	sampled = what;
+	published = -1;
+	stop = FALSE;
+
+	memory_barrier();
+
+	sampler = os_thread_create(sample_loop, NULL);
+
+	if (sampler == NULL)
+	{
+		monitor_stop();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Stops the sampler thread (waiting for it to end) and frees every buffer */
+void monitor_stop(void)
+{
+	int i = 0;
+
+	if (sampler != NULL)
+	{
+		stop = TRUE;
+		memory_barrier();
+		os_thread_join(sampler);
+		sampler = NULL;
+	}
+
+	free_snapshot(&buffers[0]);
+	free_snapshot(&buffers[1]);
+	free_snapshot(&readers[0]);
+	free_snapshot(&readers[1]);
+
+	for (i = 0; i < METRICS; ++i)
+	{
+		history_free(&histories[i]);
+	}
+
+	free(history_times);
+	free(history_values);
+	history_times = NULL;
+	history_values = NULL;
+	cpu_load_free(&load_state);
+	published = -1;
+}
+
+int monitor_running(void)
+{
+	return sampler != NULL;
+}
+
+/* Returns a copy of the latest published sample (valid until next call), NULL if there is none yet
+** Never waits : if the sampler keeps overwriting the buffer being copied, previous copy is returned */
+const monitor_snapshot_t *monitor_latest(void)
+{
+	monitor_snapshot_t *copy = &readers[1 - reader];
+	int attempt = 0;
+
+	if (sampler == NULL)
+	{
+		return NULL;
+	}
+
+	for (attempt = 0; attempt < MAX_COPY_ATTEMPTS; ++attempt)
+	{
+		long index = published;
+		const monitor_snapshot_t *snapshot = NULL;
+		long sequence = 0;
+
+		if (index < 0)
+		{
+			return NULL;
+		}
+
+		snapshot = &buffers[index];
+		sequence = snapshot->sequence;
+		memory_barrier();
+
+		// the sampler has already started to write the next sample into it
+		if (sequence & 1)
+		{
+			continue;
+		}
+
+		copy->time = snapshot->time;
+		copy->index = snapshot->index;
+		copy->what = snapshot->what;
+		copy->cpu_count = snapshot->cpu_count;
+		copy->freq_count = snapshot->freq_count;
+		copy->mem = snapshot->mem;
+		memcpy(copy->cpus, snapshot->cpus, copy->cpu_count * sizeof(cpu_load_t));
+		memcpy(copy->freqs, snapshot->freqs, copy->freq_count * sizeof(cpu_freq_t));
+
+		memory_barrier();
+
+		// nothing has been written meanwhile : the copy is consistent
+		if (snapshot->sequence == sequence)
+		{
+			copy->sequence = sequence;
+			reader = 1 - reader;
+			break;
+		}
+	}
+
+	return (readers[reader].sequence != 0) ? &readers[reader] : NULL;
+}
+
+/* Points times and values to the samples of given metric (METRIC_*) taken during the last seconds (oldest first)
+** and fills stats with aggregates over the whole history, returns how many samples there are
+** Arrays stay valid until next call, nothing is allocated */
+int monitor_history(int metric, double seconds, const double **times, const double **values, history_stats_t *stats)
+{
+	int count = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (sampler == NULL || metric < 0 || metric >= METRICS)
+	{
+		return 0;
+	}
+
+	count = history_copy(&histories[metric], monotonic_seconds() - seconds, history_times, history_values);
+
+	// never waits : if the sampler keeps updating the aggregates, previous copy is returned
+	if (history_stats(&histories[metric], stats))
+	{
+		history_last[metric] = *stats;
+	}
+	else
+	{
+		*stats = history_last[metric];
+	}
+
+	*times = history_times;
+	*values = history_values;
+
+	return count;
+}
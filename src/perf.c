@@ -0,0 +1,183 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+static perf_region_t *regions = NULL;
+static int regions_count = 0;
+static int regions_capacity = 0;
+
+/* Returns the region with given name (created if needed and create is TRUE), NULL if not found */
+static perf_region_t *find_region(const char *name, int create)
+{
+	int i = 0;
+
+	for (i = 0; i < regions_count; ++i)
+	{
+		if (strncmp(regions[i].name, name, PERF_MAX_NAME - 1) == 0)
+		{
+			return &regions[i];
+		}
+	}
+
+	if (create == FALSE)
+	{
+		return NULL;
+	}
+
+	if (regions_count == regions_capacity)
+	{
+		int capacity = regions_capacity ? 2 * regions_capacity : 16;
+		perf_region_t *grown = realloc(regions, capacity * sizeof(perf_region_t));
+
+		if (grown == NULL)
+		{
+			return NULL;
+		}
+
+		regions = grown;
+		regions_capacity = capacity;
+	}
+
+	memset(&regions[regions_count], 0, sizeof(perf_region_t));
+	strncpy(regions[regions_count].name, name, PERF_MAX_NAME - 1);
+
+	return &regions[regions_count++];
+}
+
+/* Starts counting for given region, returns FALSE if out of memory */
+int perf_begin(const char *name)
+{
+	perf_region_t *region = find_region(name, TRUE);
+
+	if (region == NULL)
+	{
+		return FALSE;
+	}
+
+	if (region->depth++ == 0)
+	{
+		os_perf_open();
+		region->start_ticks = timer_ticks();
+		// counters are read last so that they cover as little of the plugin as possible
+		os_perf_read(&region->start);
+	}
+
+	return TRUE;
+}
+
+/* Stops counting for given region and adds counters to its totals, returns FALSE if it wasn't started */
+int perf_end(const char *name)
+{
+	perf_region_t *region = find_region(name, FALSE);
+	perf_sample_t end;
+	uint64_t enabled = 0;
+	uint64_t running = 0;
+	double scale = 1.0;
+	uint64_t ticks = 0;
+	int i = 0;
+
+	if (region == NULL || region->depth == 0)
+	{
+		return FALSE;
+	}
+
+	// only the outermost end of a recursive region counts
+	if (--region->depth > 0)
+	{
+		return TRUE;
+	}
+
+	os_perf_read(&end);
+	ticks = timer_ticks();
+
+	// multiplexed with other users of the PMU : extrapolate from the time the group ran during this region only
+	if (end.time_running > region->start.time_running && end.time_enabled > region->start.time_enabled)
+	{
+		enabled = end.time_enabled - region->start.time_enabled;
+		running = end.time_running - region->start.time_running;
+	}
+
+	if (running > 0 && running < enabled)
+	{
+		scale = (double)enabled / running;
+	}
+
+	for (i = 0; i < PERF_COUNTERS; ++i)
+	{
+		// counters reopened meanwhile start again from 0
+		uint64_t delta = (end.values[i] > region->start.values[i]) ? end.values[i] - region->start.values[i] : 0;
+
+		if ((end.grouped >> i) & 1)
+		{
+			delta = (uint64_t)(delta * scale);
+		}
+
+		region->totals[i] += delta;
+	}
+
+	region->elapsed_ns += timer_ticks_to_ns((double)(ticks - region->start_ticks));
+	++region->calls;
+
+	return TRUE;
+}
+
+const perf_region_t *perf_regions(int *count)
+{
+	*count = regions_count;
+
+	return regions;
+}
+
+/* Returns the mask of PERF_* counters available (0 if none) */
+uint32_t perf_counters(void)
+{
+	return os_perf_open();
+}
+
+/* Clears totals of every region, running regions keep running */
+void perf_reset(void)
+{
+	int i = 0;
+
+	for (i = 0; i < regions_count; ++i)
+	{
+		regions[i].calls = 0;
+		regions[i].elapsed_ns = 0.0;
+		memset(regions[i].totals, 0, sizeof(regions[i].totals));
+	}
+}
+
+void perf_free(void)
+{
+	free(regions);
+	regions = NULL;
+	regions_count = 0;
+	regions_capacity = 0;
+}
@@ -31,21 +31,6 @@
 #include "sfpplugin.h"
 #include "version.h"
 
-#ifdef _MSC_VER
-#define MSVC_COMPILER 1
-#else
-#define MSVC_COMPILER 0
-#endif
-
-#if MSVC_COMPILER
-#  include <intrin.h>
-#else
-#  include <cpuid.h>
-#  include <x86intrin.h>
-#endif
-
-#include <stdint.h>
-
 // pointer to the Hollywood plugin API
 hwPluginAPI *hwcl = NULL;
 
@@ -128,161 +113,19 @@ HW_EXPORT int InitPlugin(hwPluginBase *self, hwPluginAPI *cl, STRPTR path)
 */
 HW_EXPORT void ClosePlugin(void)
 {
+	// the sampler thread must not outlive the plugin code
+	monitor_stop();
+
 #ifdef HW_AMIGA
 	freeamigastuff();
 #endif
 }
 
-#define EDX_FEATURES_SIZE     29
-#define ECX_FEATURES_SIZE     30
-#define EBX_EXT_FEATURES_SIZE 30
-#define ECX_EXT_FEATURES_SIZE  6
-#define ECX_EXT_FUNCTIONS_SIZE  10
-#define EDX_EXT_FUNCTIONS_SIZE  8
-
-typedef struct
-{
-	const char* name;
-	int mask;
-
-} feature_t;
-
-
-const feature_t EdxFeatures[EDX_FEATURES_SIZE] =
-{
-	{ "FPU",           (1 <<  0) },
-	{ "VME",           (1 <<  1) },
-	{ "DE",            (1 <<  2) },
-	{ "PSE",           (1 <<  3) },
-	{ "TSC",           (1 <<  4) },
-	{ "MSR",           (1 <<  5) },
-	{ "PAE",           (1 <<  6) },
-	{ "MCE",           (1 <<  7) },
-	{ "CX8",           (1 <<  8) },
-	{ "APIC",          (1 <<  9) },
-	{ "SEP",           (1 << 11) },
-	{ "MTRR",          (1 << 12) },
-	{ "PGE",           (1 << 13) },
-	{ "MCA",           (1 << 14) },
-	{ "CMOV",          (1 << 15) },
-	{ "PAT",           (1 << 16) },
-	{ "PSE-36",        (1 << 17) },
-	{ "PSN",           (1 << 18) },
-	{ "CLFSH",         (1 << 19) },
-	{ "DS",            (1 << 21) },
-	{ "ACPI",          (1 << 22) },
-	{ "MMX",           (1 << 23) },
-	{ "FXSR",          (1 << 24) },
-	{ "SSE",           (1 << 25) },
-	{ "SSE2",          (1 << 26) },
-	{ "SS",            (1 << 27) },
-	{ "HTT",           (1 << 28) },
-	{ "TM",            (1 << 29) },
-	{ "PBE",           (1 << 31) }
-};
-
-const feature_t EcxFeatures[ECX_FEATURES_SIZE] =
-{
-	{ "SSE3",          (1 <<  0) },
-	{ "PCLMULQDQ",     (1 <<  1) },
-	{ "DTES64",        (1 <<  2) },
-	{ "MONITOR",       (1 <<  3) },
-	{ "DS-CPL",        (1 <<  4) },
-	{ "VMX",           (1 <<  5) },
-	{ "SMX",           (1 <<  6) },
-	{ "EIST",          (1 <<  7) },
-	{ "TM2",           (1 <<  8) },
-	{ "SSSE3",         (1 <<  9) },
-	{ "CNXT-ID",       (1 << 10) },
-	{ "SDBG",          (1 << 11) },
-	{ "FMA",           (1 << 12) },
-	{ "CMPXCHG16B",    (1 << 13) },
-	{ "XTPR",          (1 << 14) },
-	{ "PDCM",          (1 << 15) },
-	{ "PCID",          (1 << 17) },
-	{ "DCA",           (1 << 18) },
-	{ "SSE4.1",        (1 << 19) },
-	{ "SSE4.2",        (1 << 20) },
-	{ "X2APIC",        (1 << 21) },
-	{ "MOVBE",         (1 << 22) },
-	{ "POPCNT",        (1 << 23) },
-	{ "TSC-DEADLINE",  (1 << 24) },
-	{ "AESNI",         (1 << 25) },
-	{ "XSAVE",         (1 << 26) },
-	{ "OSXSAVE",       (1 << 27) },
-	{ "AVX",           (1 << 28) },
-	{ "F16C",          (1 << 29) },
-	{ "RDRND",         (1 << 30) }
-};
-
-const feature_t EbxExtFeatures[EBX_EXT_FEATURES_SIZE] =
-{
-	{ "FSGSBASE",      (1 <<  0) },
-	{ "IA32-TSC-ADJ",  (1 <<  1) },
-	{ "SGX",           (1 <<  2) },
-	{ "BMI1",          (1 <<  3) },
-	{ "HLE",           (1 <<  4) },
-	{ "AVX2",          (1 <<  5) },
-	{ "FDP-EXCP",      (1 <<  6) },
-	{ "SMEP",          (1 <<  7) },
-	{ "BMI2",          (1 <<  8) },
-	{ "ENHANCED-RMS",  (1 <<  9) },
-	{ "INVPCID",       (1 << 10) },
-	{ "RTM",           (1 << 11) },
-	{ "RDT-M",         (1 << 12) },
-	{ "DEPR-FCSDS",    (1 << 13) },
-	{ "MPX",           (1 << 14) },
-	{ "RDT-A",         (1 << 15) },
-	{ "AVX512F",       (1 << 16) },
-	{ "AVX512DQ",      (1 << 17) },
-	{ "RDSEED",        (1 << 18) },
-	{ "ADX",           (1 << 19) },
-	{ "SMAP",          (1 << 20) },
-	{ "CLFLUSHOPT",    (1 << 23) },
-	{ "CLWB",          (1 << 24) },
-	{ "INTEL-PTRACE",  (1 << 25) },
-	{ "AVX512PF",      (1 << 26) },
-	{ "AVX512ER",      (1 << 27) },
-	{ "AVX512CD",      (1 << 28) },
-	{ "SHA",           (1 << 29) },
-	{ "AVX512BW",      (1 << 30) },
-	{ "AVX512VL",      (1 << 31) }
-};
-
-const feature_t EcxExtFeatures[ECX_EXT_FEATURES_SIZE] =
-{
-	{ "PREFETCHWT1",   (1 <<  0) },
-	{ "UMIP",          (1 <<  2) },
-	{ "PKU",           (1 <<  3) },
-	{ "OSPKE",         (1 <<  4) },
-	{ "RPID",          (1 << 22) },
-	{ "SGX-LC",        (1 << 30) }
-};
-
-const feature_t EcxExtFunctions[ECX_EXT_FUNCTIONS_SIZE] =
-{
-	{ "LAHF-SAHF",     (1 <<  0) },
-	{ "SVM",           (1 <<  2) },
-	{ "LZCNT",         (1 <<  5) },
-	{ "SSE4A",         (1 <<  6) },
-	{ "PREFETCHW",     (1 <<  8) },
-	{ "XOP",           (1 << 11) },
-	{ "SKINIT",        (1 << 12) },
-	{ "FMA4",          (1 << 16) },
-	{ "TBM",           (1 << 21) },
-	{ "MONITORX",      (1 << 29) }
-};
-
-const feature_t EdxExtFunctions[EDX_EXT_FUNCTIONS_SIZE] =
+const feature_t Features[FEATURES_COUNT] =
 {
-	{ "SYSCALL-SYSRET",(1 << 11) },
-	{ "EXD",           (1 << 20) },
-	{ "MMX_ext",       (1 << 22) },
-	{ "1GB_pages",     (1 << 26) },
-	{ "RDTSCP",        (1 << 27) },
-	{ "64_bit_mode",   (1 << 29) },
-	{ "3DNow_ext",     (1 << 30) },
-	{ "3DNow",         (1 << 31) }
+#define FEATURE(id, name, leaf, subleaf, reg, bit) { name, leaf, subleaf, CPUID_##reg, bit },
+#include "cpufeatures.h"
+#undef FEATURE
 };
 
 const char* CacheTlbDescriptors[256] =
@@ -512,296 +355,1219 @@ const char* microarch_info(uint32_t model_num)
 	}
 }
 
-/*
-static uint64_t xgetbv(uint32_t xsr)
+/* Reads an extended control register, only valid when CPUID reports OSXSAVE */
+static uint64_t xgetbv(uint32_t xcr)
 {
 #if MSVC_COMPILER
-    uint32_t eax_, edx_;
-    __asm {
-        mov ecx, [xsr]
-        __asm _emit 0x0f __asm _emit 0x01 __asm _emit 0xd0
-        mov eax_, eax
-        mov edx_, edx
-    }
-    return ((uint64_t)edx_ << 32) | eax_;
+	return _xgetbv(xcr);
 #else
-    uint32_t hi, lo;
-    asm ("xgetbv"
-            : "=d" (hi), "=a" (lo)
-            : "c" (xsr));
+	uint32_t hi, lo;
 
-    return (uint64_t(hi) << 32) | lo;
+	// encoded by hand for assemblers which don't know the mnemonic
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"
+			: "=d" (hi), "=a" (lo)
+			: "c" (xcr));
+
+	return ((uint64_t)hi << 32) | lo;
 #endif
 }
-*/
 
-uint32_t info[4];
-uint32_t functionID;
-uint32_t subfunctionID;
-int valid;
+static cpuid_snapshot_t snapshot;
+static int snapshot_taken = FALSE;
+static double snapshot_time = 0.0;
 
-int get2(uint32_t function, uint32_t subfunction)
+// how many times the whole CPUID set has been captured and how many CPUID instructions it took
+static uint32_t cpuid_passes = 0;
+static uint32_t cpuid_instructions = 0;
+// same for the captures of every logical processor (see cpuid_capture_cpu()), kept apart from the process snapshot
+static uint32_t cpuid_core_passes = 0;
+static uint32_t cpuid_core_instructions = 0;
+
+static void cpuid_exec(uint32_t function, uint32_t subfunction, uint32_t regs[4], uint32_t *instructions)
 {
 #if MSVC_COMPILER
-        uint32_t tmp_info[4];
+	__cpuidex((int *)regs, function, subfunction);
+#else
+	__cpuid_count(function, subfunction, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	++*instructions;
+}
 
-        if (function > 0)
-        {
-            __cpuid(tmp_info, function & 0x80000000);
+/* Returns how many sub-leaves of a leaf are worth capturing, given its sub-leaf 0 */
+static uint32_t cpuid_subleaves(uint32_t function, const uint32_t regs[4])
+{
+	switch (function)
+	{
+	// deterministic cache parameters : enumeration stops at the first "null" cache type
+	case 0x04:
+	case 0x8000001D:
+		return CPUID_SUBLEAVES;
+	// extended topology : enumeration stops at the first "invalid" level type
+	case 0x0B:
+	case 0x1F:
+		return CPUID_SUBLEAVES;
+	// structured extended features : eax gives the maximum sub-leaf
+	case 0x07:
+		return (regs[0] + 1 < CPUID_SUBLEAVES) ? regs[0] + 1 : CPUID_SUBLEAVES;
+	// processor extended state : sub-leaf 1 holds XSAVEOPT/XSAVEC/...
+	case 0x0D:
+		return 2;
+	default:
+		return 1;
+	}
+}
 
-            if (tmp_info[0] < function)
-            {
-                memset(info, 0, 4 * sizeof(*info));
-                return valid = 0;
-            }
-        }
+/* Returns TRUE if given sub-leaf terminates the enumeration of its leaf */
+static int cpuid_last_subleaf(uint32_t function, const uint32_t regs[4])
+{
+	switch (function)
+	{
+	case 0x04:
+	case 0x8000001D:
+		return (regs[0] & 0x1F) == 0;
+	case 0x0B:
+	case 0x1F:
+		return ((regs[2] >> 8) & 0xFF) == 0;
+	default:
+		return FALSE;
+	}
+}
 
-        __cpuidex(info, functionID, subfunctionID);
+static void cpuid_capture_leaf(uint32_t function, uint32_t regs[CPUID_SUBLEAVES][4], uint32_t *instructions)
+{
+	uint32_t sub = 0;
+	uint32_t count = 0;
 
-        return valid = 1;
-#else
-        unsigned int _eax, _ebx, _ecx, _edx;
+	cpuid_exec(function, 0, regs[0], instructions);
 
-        if (function > 0)
-        {
-            __cpuid(function & 0x80000000, _eax, _ebx, _ecx, _edx);
+	if (cpuid_last_subleaf(function, regs[0]))
+	{
+		return;
+	}
 
-            if (_eax < function)
-            {
-                memset(info, 0, 4 * sizeof(*info));
-                return valid = 0;
-            }
-        }
+	count = cpuid_subleaves(function, regs[0]);
 
-        __cpuid_count(function, subfunction, info[0], info[1], info[2], info[3]);
+	for (sub = 1; sub < count; ++sub)
+	{
+		cpuid_exec(function, sub, regs[sub], instructions);
 
-        return valid = 1;
-#endif
+		if (cpuid_last_subleaf(function, regs[sub]))
+		{
+			break;
+		}
+	}
 }
 
-int get(uint32_t function)
+/* Executes CPUID for every leaf and sub-leaf the plugin knows about and stores results in snap */
+static void cpuid_capture_counted(cpuid_snapshot_t *snap, uint32_t *passes, uint32_t *instructions)
 {
-	return get2(function, 0);
-}
+	uint32_t function = 0;
 
-uint32_t eax()  {return valid * info[0];}
-uint32_t ebx()  {return valid * info[1];}
-uint32_t ecx()  {return valid * info[2];}
-uint32_t edx()  {return valid * info[3];}
+	memset(snap, 0, sizeof(*snap));
 
-uint32_t eax2(unsigned bit, unsigned length)  {return valid * ((info[0] >> bit) & ((1ul << length) - 1));}
-uint32_t ebx2(unsigned bit, unsigned length)  {return valid * ((info[1] >> bit) & ((1ul << length) - 1));}
-uint32_t ecx2(unsigned bit, unsigned length)  {return valid * ((info[2] >> bit) & ((1ul << length) - 1));}
-uint32_t edx2(unsigned bit, unsigned length)  {return valid * ((info[3] >> bit) & ((1ul << length) - 1));}
+	cpuid_exec(0, 0, snap->std[0][0], instructions);
+	snap->max_standard_leaf = snap->std[0][0][0];
 
-uint32_t eax1(unsigned bit)  {return eax2(bit, 1);}
-uint32_t ebx1(unsigned bit)  {return ebx2(bit, 1);}
-uint32_t ecx1(unsigned bit)  {return ecx2(bit, 1);}
-uint32_t edx1(unsigned bit)  {return edx2(bit, 1);}
+	for (function = 1; function <= snap->max_standard_leaf && function < CPUID_STD_LEAVES; ++function)
+	{
+		cpuid_capture_leaf(function, snap->std[function], instructions);
+	}
 
-#define I(f) { lua_pushstring(L, #f); lua_pushnumber(L, f()); lua_rawset(L, -3); }
-#define S(f) { lua_pushstring(L, #f); lua_pushstring(L, f()); lua_rawset(L, -3); }
-#define T(f) { lua_pushstring(L, #f); lua_pushboolean(L, thermal_##f()); lua_rawset(L, -3); }
+	cpuid_exec(0x80000000, 0, snap->ext[0][0], instructions);
 
-void add_cache_tlb_info(lua_State *L, uint32_t reg, int *array_index)
-{
-	const char* info0 = CacheTlbDescriptors[(reg      ) & 0xFF];
-	const char* info1 = CacheTlbDescriptors[(reg >>  8) & 0xFF];
-	const char* info2 = CacheTlbDescriptors[(reg >> 16) & 0xFF];
-	const char* info3 = CacheTlbDescriptors[(reg >> 24) & 0xFF];
+	// processors without extended leaves return garbage (usually last standard leaf content)
+	if (snap->ext[0][0][0] & 0x80000000)
+	{
+		snap->max_extended_leaf = snap->ext[0][0][0];
+	}
+	else
+	{
+		memset(snap->ext[0][0], 0, sizeof(snap->ext[0][0]));
+	}
 
-	if(info0 != NULL) { lua_pushnumber(L, *array_index); lua_pushstring(L, info0); lua_rawset(L, -3); *array_index = *array_index + 1; }
-	if(info1 != NULL) { lua_pushnumber(L, *array_index); lua_pushstring(L, info1); lua_rawset(L, -3); *array_index = *array_index + 1; }
-	if(info2 != NULL) { lua_pushnumber(L, *array_index); lua_pushstring(L, info2); lua_rawset(L, -3); *array_index = *array_index + 1; }
-	if(info3 != NULL) { lua_pushnumber(L, *array_index); lua_pushstring(L, info3); lua_rawset(L, -3); *array_index = *array_index + 1; }
-}
+	for (function = 0x80000001; function <= snap->max_extended_leaf && function - 0x80000000 < CPUID_EXT_LEAVES; ++function)
+	{
+		cpuid_capture_leaf(function, snap->ext[function - 0x80000000], instructions);
+	}
 
-uint32_t max_standard_cpuid_leaf() {
-	get(0);
-	return eax();
-}
-uint32_t max_extended_cpuid_leaf() {
-	get(0x80000000);
-	return eax();
-}
-uint8_t processor_stepping() {
-	get(1);
-	return eax2(0, 4);
-}
-uint16_t processor_family() {
-	uint16_t temp;
-	get(1);
-	temp = eax2(8, 4);
-	if (temp != 0x0F)
-		return temp;
-	else
-		return temp + eax2(20, 8);
-}
-uint8_t processor_model() {
-	uint16_t family;
-	get(1);
-	family = processor_family();
-	if (family == 0x06 || family == 0x0F)
-		return (eax2(16, 4) << 4) + eax2(4, 4);
-	return eax2(4, 4);
-}
-uint8_t processor_type() {
-	get(1);
-	return eax2(12, 2);
-}
-uint8_t processor_brand_index() {
-	get(1);
-	return ebx(0, 8);
-}
-uint16_t processor_cache_line_size() {
-	get(1);
-	return ebx(8, 8) * 8;
-}
-uint32_t max_SOCID_index() {
-	get(0x17);
-	return eax();
-}
-uint16_t SOC_vendor_ID() {
-	get(0x17);
-	return ebx(0, 16);
-}
-uint8_t cache_line_size() {
-	get(0x80000006);
-	return ecx(0, 8);
-}
-uint32_t cache_size() {
-	get(0x80000006);
-	return ecx(16, 16) * 1024;
-}
+	// XGETBV faults unless the OS has set CR4.OSXSAVE, which CPUID mirrors
+	if (snap->max_standard_leaf >= 1 && (snap->std[1][0][2] & (1 << 27)))
+	{
+		snap->xcr0 = xgetbv(0);
+	}
 
-uint8_t physical_address_bits() {
-	get(0x80000008);
-	return eax2(0, 8);
-}
-uint8_t linear_address_bits() {
-	get(0x80000008);
-	return eax2(8, 8);
+	++*passes;
 }
 
-uint16_t processor_base_frequency_MHz() {
-	return eax(0, 16);
-}
-uint16_t processor_max_frequency_MHz() {
-	return ebx(0, 16);
-}
-uint16_t processor_bus_reference_frequency_MHz() {
-	return ecx(0, 16);
+void cpuid_capture(cpuid_snapshot_t *snap)
+{
+	cpuid_capture_counted(snap, &cpuid_passes, &cpuid_instructions);
 }
 
-const char *vendor()
+/* Same as cpuid_capture() for the processor the calling thread has been pinned on (one thread at a time) */
+void cpuid_capture_cpu(cpuid_snapshot_t *snap)
 {
-    char vendor_string[16] = {0};
-
-    get(0);
+	cpuid_capture_counted(snap, &cpuid_core_passes, &cpuid_core_instructions);
+}
 
-	*(uint32_t *)(&vendor_string[0]) = ebx();
-	*(uint32_t *)(&vendor_string[4]) = edx();
-	*(uint32_t *)(&vendor_string[8]) = ecx();
-	vendor_string[12] = 0;
+/* Returns the snapshot of the processor the plugin runs on, capturing it on first call */
+const cpuid_snapshot_t *cpuid_snapshot(void)
+{
+	if (snapshot_taken == FALSE)
+	{
+		cpuid_capture(&snapshot);
+		snapshot_time = monotonic_seconds();
+		snapshot_taken = TRUE;
+	}
 
-    return strdup(vendor_string);
+	return &snapshot;
 }
 
-const char *processor_brand_string()
+/* Returns registers eax, ebx, ecx and edx of a leaf/sub-leaf or NULL if processor doesn't support it */
+const uint32_t *cpuid_leaf(const cpuid_snapshot_t *snap, uint32_t function, uint32_t subfunction)
 {
-	uint32_t idx = 0;
-	uint32_t brand_idx = 0;
-	char *ns = 0;
-	uint32_t brand[12] = {0};
-
-	for(idx = 0 ; idx < 3 ; ++idx)
+	if (subfunction >= CPUID_SUBLEAVES)
 	{
-		get(0x80000002 + idx);
-		*(uint32_t *)&brand[brand_idx] = eax();
-		*(uint32_t *)&brand[brand_idx+1] = ebx();
-		*(uint32_t *)&brand[brand_idx+2] = ecx();
-		*(uint32_t *)&brand[brand_idx+3] = edx();
-
-		brand_idx += 4;
+		return NULL;
 	}
 
-	for(ns = (char *)brand ;  ; ++ns)
+	if (function & 0x80000000)
 	{
-		if (*ns != ' ')
+		if (function > snap->max_extended_leaf || function - 0x80000000 >= CPUID_EXT_LEAVES)
 		{
-			break;
+			return NULL;
 		}
+
+		return snap->ext[function - 0x80000000][subfunction];
 	}
 
-    return strdup(ns);
+	if (function > snap->max_standard_leaf || function >= CPUID_STD_LEAVES)
+	{
+		return NULL;
+	}
+
+	return snap->std[function][subfunction];
 }
 
-const char *processor_brand_name()
+/* Decodes every feature of Features[] from the snapshot into a bitset */
+void feature_set_capture(const cpuid_snapshot_t *snap, feature_set_t *set)
 {
-    get(1);
+	int i = 0;
 
-    switch (ebx() & 0xff) {
-        default: return "";
-        case 0x01: // Fallthrough
-        case 0x0A: // Fallthrough
-        case 0x14: return "Intel(R) Celeron(R) processor";
-        case 0x02: // Fallthrough
-        case 0x04: return "Intel(R) Pentium(R) III processor";
-        case 0x03: return eax() == 0x000006B1? "Intel(R) Celeron(R) processor": "Intel(R) Pentium(R) III Xeon(R) processor";
-        case 0x06: return "Mobile Intel(R) Pentium(R) III processor-M";
-        case 0x07: return "Mobile Intel(R) Celeron(R) processor";
-        case 0x08: // Fallthrough
-        case 0x09: return "Intel(R) Pentium(R) 4 processor";
-        case 0x0B: return eax() == 0x00000F13? "Intel(R) Xeon(R) processor MP": "Intel(R) Xeon(R) processor";
-        case 0x0C: return "Intel(R) Xeon(R) processor MP";
-        case 0x0E: return eax() == 0x00000F13? "Intel(R) Xeon(R) processor": "Mobile Intel(R) Pentium(R) 4 processor-M";
-        case 0x0F: // Fallthrough
-        case 0x17: return "Mobile Intel(R) Celeron(R) processor";
-        case 0x11: // Fallthrough
-        case 0x15: return "Mobile Genuine Intel(R) processor";
-        case 0x12: return "Intel(R) Celeron(R) M processor";
-        case 0x13: return "Mobile Intel(R) Celeron(R) processor";
-        case 0x16: return "Intel(R) Pentium(R) M processor";
-    }
+	memset(set, 0, sizeof(*set));
+
+	for (i = 0; i < FEATURES_COUNT; ++i)
+	{
+		const uint32_t *regs = cpuid_leaf(snap, Features[i].leaf, Features[i].subleaf);
+
+		if (regs != NULL && (regs[Features[i].reg] >> Features[i].bit) & 1)
+		{
+			set->bits[i >> 5] |= 1u << (i & 31);
+		}
+	}
 }
 
-void new_table(void *state, const char *name)
+static feature_set_t features;
+static int features_decoded = FALSE;
+
+/* Returns features of the processor, decoded once from the CPUID snapshot */
+const feature_set_t *feature_set(void)
 {
-	lua_State *L = (lua_State *)state;
-	lua_pushstring(L, name);
-	lua_newtable(L);
+	if (features_decoded == FALSE)
+	{
+		feature_set_capture(cpuid_snapshot(), &features);
+		features_decoded = TRUE;
+	}
+
+	return &features;
 }
 
-void close_table(void *state)
+#include "featurehash.h"
+
+// featurehash.h must be generated again (genfeatures.py) when cpufeatures.h changes
+typedef char feature_hash_up_to_date[(FEATURE_HASH_COUNT == FEATURES_COUNT) ? 1 : -1];
+
+/* Case insensitive FNV-1a followed by a final mix, must stay in sync with genfeatures.py */
+static uint32_t feature_hash(const char *name, uint32_t seed)
 {
-	lua_State *L = (lua_State *)state;
-	lua_rawset(L, -3);
+	uint32_t h = 0x811C9DC5 ^ seed;
+
+	for (; *name != '\0'; ++name)
+	{
+		h ^= (uint8_t)((*name >= 'A' && *name <= 'Z') ? *name + ('a' - 'A') : *name);
+		h *= 0x01000193;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+
+	return h;
 }
 
-void add_entry(void *state, const char *key, const char *value)
+static int same_name(const char *name1, const char *name2)
 {
-	lua_State *L = (lua_State *)state;
-	lua_pushstring(L, key);
-	lua_pushstring(L, value);
-	lua_rawset(L, -3);
+	for (; *name1 != '\0' && *name2 != '\0'; ++name1, ++name2)
+	{
+		char c1 = (*name1 >= 'A' && *name1 <= 'Z') ? *name1 + ('a' - 'A') : *name1;
+		char c2 = (*name2 >= 'A' && *name2 <= 'Z') ? *name2 + ('a' - 'A') : *name2;
+
+		if (c1 != c2)
+		{
+			return FALSE;
+		}
+	}
+
+	return *name1 == *name2;
 }
 
-/* Returns a table containing informations about processor and system */
-static SAVEDS int hw_SysInfo(lua_State *L)
+/* Returns the FEATURE_* identifier of given feature name (case insensitive), -1 if unknown */
+int feature_lookup(const char *name)
 {
-	uint32_t i = 0;
-	int array_index = 0;
+	uint32_t bucket = feature_hash(name, 0) % FEATURE_HASH_BUCKETS;
+	int id = FeatureHashSlots[feature_hash(name, FeatureHashSeeds[bucket]) % FEATURE_HASH_SLOTS];
 
-	lua_newtable(L);
-
-	lua_pushstring(L, "cpu");
-	lua_newtable(L);
+	return (id >= 0 && same_name(Features[id].name, name)) ? id : -1;
+}
 
-	lua_pushstring(L, "ident");
-	lua_newtable(L);
+static int has_all(const feature_set_t *set, const int *ids, int count)
+{
+	int i = 0;
 
-	S(vendor)
-	S(processor_brand_string)
+	for (i = 0; i < count; ++i)
+	{
+		if (!feature_test(set, ids[i]))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+#define HAS_ALL(set, ids) has_all(set, ids, sizeof(ids) / sizeof(ids[0]))
+
+/* Returns the highest x86-64 micro-architecture level whose instructions are all supported by the
+** processor and whose registers state is enabled by the operating system (see ISA_LEVEL_*) */
+int isa_level(const cpuid_snapshot_t *snap)
+{
+	static const int Baseline[] = { FEATURE_FPU, FEATURE_CX8, FEATURE_CMOV, FEATURE_MMX, FEATURE_FXSR, FEATURE_SSE, FEATURE_SSE2,
+		FEATURE_SYSCALL_SYSRET, FEATURE_64_BIT_MODE };
+	static const int V2[] = { FEATURE_SSE3, FEATURE_SSSE3, FEATURE_CMPXCHG16B, FEATURE_SSE4_1, FEATURE_SSE4_2, FEATURE_POPCNT,
+		FEATURE_LAHF_SAHF };
+	static const int V3[] = { FEATURE_FMA, FEATURE_MOVBE, FEATURE_OSXSAVE, FEATURE_AVX, FEATURE_F16C, FEATURE_BMI1, FEATURE_AVX2,
+		FEATURE_BMI2, FEATURE_LZCNT };
+	static const int V4[] = { FEATURE_AVX512F, FEATURE_AVX512DQ, FEATURE_AVX512CD, FEATURE_AVX512BW, FEATURE_AVX512VL };
+	feature_set_t set;
+
+	feature_set_capture(snap, &set);
+
+	if (!HAS_ALL(&set, Baseline))
+	{
+		return ISA_LEVEL_NONE;
+	}
+
+	if (!HAS_ALL(&set, V2))
+	{
+		return ISA_LEVEL_BASELINE;
+	}
+
+	if (!HAS_ALL(&set, V3) || (snap->xcr0 & XCR0_AVX_STATE) != XCR0_AVX_STATE)
+	{
+		return ISA_LEVEL_V2;
+	}
+
+	if (!HAS_ALL(&set, V4) || (snap->xcr0 & XCR0_AVX512_STATE) != XCR0_AVX512_STATE)
+	{
+		return ISA_LEVEL_V3;
+	}
+
+	return ISA_LEVEL_V4;
+}
+
+static int cache_compare(const void *arg1, const void *arg2)
+{
+	const cache_level_t *cache1 = (const cache_level_t *)arg1;
+	const cache_level_t *cache2 = (const cache_level_t *)arg2;
+
+	if (cache1->level != cache2->level)
+	{
+		return cache1->level - cache2->level;
+	}
+
+	return cache1->type - cache2->type;
+}
+
+/* Decodes deterministic cache parameters (leaf 4 on Intel, 0x8000001D on AMD) into caches */
+int cpuid_caches(const cpuid_snapshot_t *snap, cache_level_t *caches, int max)
+{
+	static const uint32_t functions[2] = { 0x04, 0x8000001D };
+	int f = 0;
+	int count = 0;
+
+	for (f = 0; f < 2 && count == 0; ++f)
+	{
+		uint32_t sub = 0;
+
+		for (sub = 0; sub < CPUID_SUBLEAVES && count < max; ++sub)
+		{
+			const uint32_t *regs = cpuid_leaf(snap, functions[f], sub);
+			cache_level_t *cache = &caches[count];
+
+			if (regs == NULL || (regs[0] & 0x1F) == 0)
+			{
+				break;
+			}
+
+			// 4 is a reserved type
+			if ((regs[0] & 0x1F) > CACHE_UNIFIED)
+			{
+				continue;
+			}
+
+			memset(cache, 0, sizeof(*cache));
+			cache->type       = regs[0] & 0x1F;
+			cache->level      = (regs[0] >> 5) & 0x07;
+			cache->sharing    = ((regs[0] >> 14) & 0xFFF) + 1;
+			cache->line_size  = (regs[1] & 0xFFF) + 1;
+			cache->partitions = ((regs[1] >> 12) & 0x3FF) + 1;
+			cache->ways       = ((regs[1] >> 22) & 0x3FF) + 1;
+			cache->sets       = regs[2] + 1;
+			cache->inclusive  = (regs[3] >> 1) & 1;
+			cache->size       = (uint32_t)cache->ways * cache->partitions * cache->line_size * cache->sets;
+
+			++count;
+		}
+	}
+
+	qsort(caches, count, sizeof(cache_level_t), cache_compare);
+
+	return count;
+}
+
+/* Returns the cache hierarchy from CPUID, cross-checked with (or, if CPUID can't tell, taken from) the OS */
+int cache_hierarchy(cache_level_t *caches, int max)
+{
+	cache_level_t os[MAX_CACHE_LEVELS];
+	int os_count = os_caches(os, MAX_CACHE_LEVELS);
+	int count = cpuid_caches(cpuid_snapshot(), caches, max);
+	int i = 0;
+	int j = 0;
+
+	if (count == 0)
+	{
+		for (i = 0; i < os_count && count < max; ++i)
+		{
+			caches[count] = os[i];
+			caches[count].os_size = os[i].size;
+			++count;
+		}
+
+		qsort(caches, count, sizeof(cache_level_t), cache_compare);
+
+		return count;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		for (j = 0; j < os_count; ++j)
+		{
+			if (os[j].level == caches[i].level && os[j].type == caches[i].type)
+			{
+				caches[i].os_size = os[j].size;
+				break;
+			}
+		}
+	}
+
+	return count;
+}
+
+/* Decodes extended topology leaves (0x1F, then 0xB) and AMD leaf 0x8000001E */
+void cpuid_topology(const cpuid_snapshot_t *snap, cpuid_topology_t *topology)
+{
+	static const uint32_t functions[2] = { 0x1F, 0x0B };
+	const uint32_t *regs = NULL;
+	int f = 0;
+
+	memset(topology, 0, sizeof(*topology));
+	topology->compute_unit_id = -1;
+	topology->node_id = -1;
+	topology->nodes_per_package = -1;
+
+	for (f = 0; f < 2 && topology->source == 0; ++f)
+	{
+		uint32_t sub = 0;
+
+		for (sub = 0; sub < CPUID_SUBLEAVES; ++sub)
+		{
+			uint32_t type = 0;
+
+			regs = cpuid_leaf(snap, functions[f], sub);
+
+			if (regs == NULL || regs[1] == 0)
+			{
+				break;
+			}
+
+			type = (regs[2] >> 8) & 0xFF;
+
+			if (type == 0)
+			{
+				break;
+			}
+
+			topology->source = functions[f];
+			topology->x2apic_id = regs[3];
+
+			// 1 = SMT, 2 = core, 3 = module, 4 = tile, 5 = die
+			if (type == 1)
+			{
+				topology->smt_shift = regs[0] & 0x1F;
+				topology->logical_per_core = regs[1] & 0xFFFF;
+			}
+
+			if (type <= 4)
+			{
+				topology->core_shift = regs[0] & 0x1F;
+			}
+
+			topology->package_shift = regs[0] & 0x1F;
+			topology->logical_per_package = regs[1] & 0xFFFF;
+		}
+	}
+
+	regs = cpuid_leaf(snap, 0x8000001E, 0);
+
+	if (regs != NULL && (regs[0] | regs[1] | regs[2]) != 0)
+	{
+		topology->compute_unit_id = regs[1] & 0xFF;
+		topology->node_id = regs[2] & 0xFF;
+		topology->nodes_per_package = ((regs[2] >> 8) & 0x07) + 1;
+
+		if (topology->source == 0)
+		{
+			const uint32_t *size = cpuid_leaf(snap, 0x80000008, 0);
+
+			topology->source = 0x8000001E;
+			topology->x2apic_id = regs[0];
+			topology->logical_per_core = ((regs[1] >> 8) & 0xFF) + 1;
+			topology->smt_shift = (topology->logical_per_core > 1) ? 1 : 0;
+
+			if (size != NULL)
+			{
+				topology->logical_per_package = (size[2] & 0xFF) + 1;
+				topology->package_shift = (size[2] >> 12) & 0x0F;
+				topology->core_shift = topology->package_shift;
+			}
+		}
+	}
+}
+
+// dependent additions executed per iteration of dependency_chain()
+#define CHAIN_LENGTH 64
+
+#if MSVC_COMPILER
+#define ADD8 __asm add eax, 1 __asm add eax, 1 __asm add eax, 1 __asm add eax, 1 \
+             __asm add eax, 1 __asm add eax, 1 __asm add eax, 1 __asm add eax, 1
+#else
+#define ADD8 "add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\t" \
+             "add $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\tadd $1, %0\n\t"
+#endif
+
+/* Executes iterations * CHAIN_LENGTH additions, each one depending on the previous one : as an
+** addition has a latency of exactly one cycle, this takes iterations * CHAIN_LENGTH core cycles */
+static void dependency_chain(uint32_t iterations)
+{
+#if MSVC_COMPILER
+	__asm {
+		mov ecx, iterations
+		xor eax, eax
+	chain_loop:
+		ADD8 ADD8 ADD8 ADD8 ADD8 ADD8 ADD8 ADD8
+		dec ecx
+		jnz chain_loop
+	}
+#else
+	uint32_t x = 0;
+
+	while (iterations-- > 0)
+	{
+		__asm__ __volatile__(ADD8 ADD8 ADD8 ADD8 ADD8 ADD8 ADD8 ADD8 : "+r" (x));
+	}
+#endif
+}
+
+/* Measures the clock of the calling core (and the TSC rate) over a few milliseconds */
+int measure_frequency(measured_freq_t *measured)
+{
+	const uint32_t *leaf1 = cpuid_leaf(cpuid_snapshot(), 1, 0);
+	int has_tsc = (leaf1 != NULL) && ((leaf1[3] >> 4) & 1);
+	uint32_t iterations = 1024;
+	double start = 0.0;
+	double elapsed = 0.0;
+	int run = 0;
+
+	memset(measured, 0, sizeof(*measured));
+
+	// calibrate chain length so that one run lasts about 2 ms (this also gives the core time to leave idle states)
+	for (;;)
+	{
+		start = monotonic_seconds();
+		dependency_chain(iterations);
+		elapsed = monotonic_seconds() - start;
+
+		if (elapsed >= 0.002 || iterations >= (1u << 24))
+		{
+			break;
+		}
+
+		iterations *= 2;
+	}
+
+	// keep the best of a few runs : slower ones have been interrupted or preempted
+	for (run = 0; run < 5; ++run)
+	{
+		uint64_t tsc_start = has_tsc ? __rdtsc() : 0;
+		uint64_t tsc_end = 0;
+		double mhz = 0.0;
+
+		start = monotonic_seconds();
+		dependency_chain(iterations);
+		elapsed = monotonic_seconds() - start;
+		tsc_end = has_tsc ? __rdtsc() : 0;
+
+		if (elapsed <= 0.0)
+		{
+			continue;
+		}
+
+		mhz = (double)iterations * CHAIN_LENGTH / elapsed / 1e6;
+
+		if (mhz > measured->effective_mhz)
+		{
+			measured->effective_mhz = mhz;
+			measured->tsc_mhz = (double)(tsc_end - tsc_start) / elapsed / 1e6;
+		}
+	}
+
+	return measured->effective_mhz > 0.0;
+}
+
+uint32_t info[4];
+int valid;
+
+int get2(uint32_t function, uint32_t subfunction)
+{
+	const uint32_t *regs = cpuid_leaf(cpuid_snapshot(), function, subfunction);
+
+	if (regs == NULL)
+	{
+		memset(info, 0, 4 * sizeof(*info));
+		return valid = 0;
+	}
+
+	memcpy(info, regs, 4 * sizeof(*info));
+
+	return valid = 1;
+}
+
+int get(uint32_t function)
+{
+	return get2(function, 0);
+}
+
+uint32_t eax(void)  {return valid * info[0];}
+uint32_t ebx(void)  {return valid * info[1];}
+uint32_t ecx(void)  {return valid * info[2];}
+uint32_t edx(void)  {return valid * info[3];}
+
+uint32_t eax2(unsigned bit, unsigned length)  {return valid * ((info[0] >> bit) & ((1ul << length) - 1));}
+uint32_t ebx2(unsigned bit, unsigned length)  {return valid * ((info[1] >> bit) & ((1ul << length) - 1));}
+uint32_t ecx2(unsigned bit, unsigned length)  {return valid * ((info[2] >> bit) & ((1ul << length) - 1));}
+uint32_t edx2(unsigned bit, unsigned length)  {return valid * ((info[3] >> bit) & ((1ul << length) - 1));}
+
+uint32_t eax1(unsigned bit)  {return eax2(bit, 1);}
+uint32_t ebx1(unsigned bit)  {return ebx2(bit, 1);}
+uint32_t ecx1(unsigned bit)  {return ecx2(bit, 1);}
+uint32_t edx1(unsigned bit)  {return edx2(bit, 1);}
+
+// longest path of a snapshot
+#define SNAPSHOT_PATH_SIZE 256
+
+/* Where collected values go : nested tables on top of the Lua stack (SysInfo(), MemInfo()...) or records of a
+** snapshot under the same dotted paths (Export(), Diff()), so that both always describe the same tree */
+typedef struct
+{
+	lua_State *L;                               // NULL for a snapshot
+	snapshot_t *snapshot;
+	char path[SNAPSHOT_PATH_SIZE];              // of the innermost opened table
+	size_t lengths[SNAPSHOT_MAX_DEPTH];         // of path when each table was opened
+	int items[SNAPSHOT_MAX_DEPTH];              // values and tables added to each opened table
+	int depth;
+	int skipped;                                // tables opened while path was too long or too deep
+
+} sysinfo_out_t;
+
+static void out_lua(sysinfo_out_t *out, lua_State *L)
+{
+	memset(out, 0, sizeof(*out));
+	out->L = L;
+}
+
+static void out_snapshot(sysinfo_out_t *out, snapshot_t *snapshot)
+{
+	memset(out, 0, sizeof(*out));
+	out->snapshot = snapshot;
+}
+
+/* Pushes the key (index if key is NULL) or builds the path of next item of current table in path,
+** returns FALSE if the item must be left out of the snapshot (its path would be truncated) */
+static int out_key(sysinfo_out_t *out, const char *key, int index, char *path)
+{
+	char number[16];
+	int written = 0;
+
+	if (out->L != NULL)
+	{
+		if (key != NULL)
+		{
+			lua_pushstring(out->L, key);
+		}
+		else
+		{
+			lua_pushnumber(out->L, index);
+		}
+
+		return TRUE;
+	}
+
+	++out->items[out->depth];
+
+	if (out->skipped > 0)
+	{
+		return FALSE;
+	}
+
+	if (key == NULL)
+	{
+		snprintf(number, sizeof(number), "%d", index);
+		key = number;
+	}
+
+	if (out->depth == 0)
+	{
+		written = snprintf(path, SNAPSHOT_PATH_SIZE, "%s", key);
+	}
+	else
+	{
+		written = snprintf(path, SNAPSHOT_PATH_SIZE, "%s.%s", out->path, key);
+	}
+
+	// a truncated path could collide with another one
+	return written >= 0 && written < SNAPSHOT_PATH_SIZE;
+}
+
+/* Opens a table under key (or index if key is NULL) in current table */
+static void out_open(sysinfo_out_t *out, const char *key, int index)
+{
+	char path[SNAPSHOT_PATH_SIZE];
+
+	if (!out_key(out, key, index, path) || out->depth + 1 >= SNAPSHOT_MAX_DEPTH)
+	{
+		++out->skipped;
+		return;
+	}
+
+	if (out->L != NULL)
+	{
+		lua_newtable(out->L);
+		return;
+	}
+
+	++out->depth;
+	out->lengths[out->depth] = strlen(out->path);
+	out->items[out->depth] = 0;
+	strcpy(out->path, path);
+}
+
+static void out_close(sysinfo_out_t *out)
+{
+	if (out->skipped > 0)
+	{
+		--out->skipped;
+		return;
+	}
+
+	if (out->L != NULL)
+	{
+		lua_rawset(out->L, -3);
+		return;
+	}
+
+	// keeps empty tables (no huge pages, no extended features...) as SysInfo() does
+	if (out->items[out->depth] == 0)
+	{
+		snapshot_empty(out->snapshot, out->path);
+	}
+
+	out->path[out->lengths[out->depth]] = '\0';
+	--out->depth;
+}
+
+static void out_number(sysinfo_out_t *out, const char *key, double value)
+{
+	char path[SNAPSHOT_PATH_SIZE];
+
+	if (!out_key(out, key, 0, path))
+	{
+		return;
+	}
+
+	if (out->L != NULL)
+	{
+		lua_pushnumber(out->L, value);
+		lua_rawset(out->L, -3);
+	}
+	else
+	{
+		snapshot_number(out->snapshot, path, value);
+	}
+}
+
+/* Adds value under key (or index if key is NULL), nothing if value is NULL */
+static void out_string(sysinfo_out_t *out, const char *key, int index, const char *value)
+{
+	char path[SNAPSHOT_PATH_SIZE];
+
+	if (value == NULL || !out_key(out, key, index, path))
+	{
+		return;
+	}
+
+	if (out->L != NULL)
+	{
+		lua_pushstring(out->L, value);
+		lua_rawset(out->L, -3);
+	}
+	else
+	{
+		snapshot_string(out->snapshot, path, value);
+	}
+}
+
+static void out_boolean(sysinfo_out_t *out, const char *key, int value)
+{
+	char path[SNAPSHOT_PATH_SIZE];
+
+	if (!out_key(out, key, 0, path))
+	{
+		return;
+	}
+
+	if (out->L != NULL)
+	{
+		lua_pushboolean(out->L, value);
+		lua_rawset(out->L, -3);
+	}
+	else
+	{
+		snapshot_boolean(out->snapshot, path, value);
+	}
+}
+
+#define I(f) out_number(out, #f, f());
+#define S(f) out_string(out, #f, 0, f());
+#define T(f) { lua_pushstring(L, #f); lua_pushboolean(L, thermal_##f()); lua_rawset(L, -3); }
+
+void add_cache_tlb_info(sysinfo_out_t *out, uint32_t reg, int *array_index)
+{
+	const char* info0 = CacheTlbDescriptors[(reg      ) & 0xFF];
+	const char* info1 = CacheTlbDescriptors[(reg >>  8) & 0xFF];
+	const char* info2 = CacheTlbDescriptors[(reg >> 16) & 0xFF];
+	const char* info3 = CacheTlbDescriptors[(reg >> 24) & 0xFF];
+
+	if(info0 != NULL) { out_string(out, NULL, *array_index, info0); *array_index = *array_index + 1; }
+	if(info1 != NULL) { out_string(out, NULL, *array_index, info1); *array_index = *array_index + 1; }
+	if(info2 != NULL) { out_string(out, NULL, *array_index, info2); *array_index = *array_index + 1; }
+	if(info3 != NULL) { out_string(out, NULL, *array_index, info3); *array_index = *array_index + 1; }
+}
+
+uint32_t max_standard_cpuid_leaf() {
+	get(0);
+	return eax();
+}
+uint32_t max_extended_cpuid_leaf() {
+	get(0x80000000);
+	return eax();
+}
+uint8_t processor_stepping() {
+	get(1);
+	return eax2(0, 4);
+}
+uint16_t processor_family() {
+	uint16_t temp;
+	get(1);
+	temp = eax2(8, 4);
+	if (temp != 0x0F)
+		return temp;
+	else
+		return temp + eax2(20, 8);
+}
+uint8_t processor_model() {
+	uint16_t family;
+	get(1);
+	family = processor_family();
+	if (family == 0x06 || family == 0x0F)
+		return (eax2(16, 4) << 4) + eax2(4, 4);
+	return eax2(4, 4);
+}
+uint8_t processor_type() {
+	get(1);
+	return eax2(12, 2);
+}
+uint8_t processor_brand_index() {
+	get(1);
+	return ebx2(0, 8);
+}
+uint16_t processor_cache_line_size() {
+	get(1);
+	return ebx2(8, 8) * 8;
+}
+uint32_t max_SOCID_index() {
+	get(0x17);
+	return eax();
+}
+uint16_t SOC_vendor_ID() {
+	get(0x17);
+	return ebx2(0, 16);
+}
+uint8_t cache_line_size() {
+	get(0x80000006);
+	return ecx2(0, 8);
+}
+uint32_t cache_size() {
+	get(0x80000006);
+	return ecx2(16, 16) * 1024;
+}
+
+uint8_t physical_address_bits() {
+	get(0x80000008);
+	return eax2(0, 8);
+}
+uint8_t linear_address_bits() {
+	get(0x80000008);
+	return eax2(8, 8);
+}
+
+uint16_t processor_base_frequency_MHz() {
+	return eax2(0, 16);
+}
+uint16_t processor_max_frequency_MHz() {
+	return ebx2(0, 16);
+}
+uint16_t processor_bus_reference_frequency_MHz() {
+	return ecx2(0, 16);
+}
+
+const char *vendor()
+{
+    char vendor_string[16] = {0};
+
+    get(0);
+
+	*(uint32_t *)(&vendor_string[0]) = ebx();
+	*(uint32_t *)(&vendor_string[4]) = edx();
+	*(uint32_t *)(&vendor_string[8]) = ecx();
+	vendor_string[12] = 0;
+
+    return strdup(vendor_string);
+}
+
+const char *processor_brand_string()
+{
+	uint32_t idx = 0;
+	uint32_t brand_idx = 0;
+	char *ns = 0;
+	uint32_t brand[12] = {0};
+
+	for(idx = 0 ; idx < 3 ; ++idx)
+	{
+		get(0x80000002 + idx);
+		*(uint32_t *)&brand[brand_idx] = eax();
+		*(uint32_t *)&brand[brand_idx+1] = ebx();
+		*(uint32_t *)&brand[brand_idx+2] = ecx();
+		*(uint32_t *)&brand[brand_idx+3] = edx();
+
+		brand_idx += 4;
+	}
+
+	for(ns = (char *)brand ;  ; ++ns)
+	{
+		if (*ns != ' ')
+		{
+			break;
+		}
+	}
+
+    return strdup(ns);
+}
+
+const char *processor_brand_name()
+{
+    get(1);
+
+    switch (ebx() & 0xff) {
+        default: return "";
+        case 0x01: // Fallthrough
+        case 0x0A: // Fallthrough
+        case 0x14: return "Intel(R) Celeron(R) processor";
+        case 0x02: // Fallthrough
+        case 0x04: return "Intel(R) Pentium(R) III processor";
+        case 0x03: return eax() == 0x000006B1? "Intel(R) Celeron(R) processor": "Intel(R) Pentium(R) III Xeon(R) processor";
+        case 0x06: return "Mobile Intel(R) Pentium(R) III processor-M";
+        case 0x07: return "Mobile Intel(R) Celeron(R) processor";
+        case 0x08: // Fallthrough
+        case 0x09: return "Intel(R) Pentium(R) 4 processor";
+        case 0x0B: return eax() == 0x00000F13? "Intel(R) Xeon(R) processor MP": "Intel(R) Xeon(R) processor";
+        case 0x0C: return "Intel(R) Xeon(R) processor MP";
+        case 0x0E: return eax() == 0x00000F13? "Intel(R) Xeon(R) processor": "Mobile Intel(R) Pentium(R) 4 processor-M";
+        case 0x0F: // Fallthrough
+        case 0x17: return "Mobile Intel(R) Celeron(R) processor";
+        case 0x11: // Fallthrough
+        case 0x15: return "Mobile Genuine Intel(R) processor";
+        case 0x12: return "Intel(R) Celeron(R) M processor";
+        case 0x13: return "Mobile Intel(R) Celeron(R) processor";
+        case 0x16: return "Intel(R) Pentium(R) M processor";
+    }
+}
+
+static systable_t systable;
+static int systable_valid = FALSE;
+static double systable_time = 0.0;
+static uint32_t systable_collections = 0;
+void new_table(void *state, const char *name)
+{
+	systable_t *table = (systable_t *)state;
+	free(table->group);
+	table->group = strdup(name);
+}
+
+void close_table(void *state)
+{
+	systable_t *table = (systable_t *)state;
+	free(table->group);
+	table->group = NULL;
+}
+
+void add_entry(void *state, const char *key, const char *value)
+{
+	systable_t *table = (systable_t *)state;
+	sysentry_t *entry = NULL;
+
+	if (table->count == table->capacity)
+	{
+		int capacity = (table->capacity == 0) ? 32 : table->capacity * 2;
+		sysentry_t *entries = realloc(table->entries, capacity * sizeof(sysentry_t));
+
+		if (entries == NULL)
+		{
+			return;
+		}
+
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+
+	entry = &table->entries[table->count++];
+	entry->group = (table->group != NULL) ? strdup(table->group) : NULL;
+	entry->key = strdup(key);
+	entry->value = strdup(value);
+}
+
+static void free_systable(systable_t *table)
+{
+	int i = 0;
+
+	for (i = 0; i < table->count; ++i)
+	{
+		free(table->entries[i].group);
+		free(table->entries[i].key);
+		free(table->entries[i].value);
+	}
+
+	free(table->entries);
+	free(table->group);
+	memset(table, 0, sizeof(*table));
+}
+
+/* Returns the sys table, collecting it from the operating system on first call (or after Refresh()) */
+static const systable_t *get_systable(void)
+{
+	if (systable_valid == FALSE)
+	{
+		free_systable(&systable);
+		fill_systable((void *)&systable);
+		close_table((void *)&systable);
+
+		systable_time = monotonic_seconds();
+		++systable_collections;
+		systable_valid = TRUE;
+	}
+
+	return &systable;
+}
+
+static int same_group(const char *group1, const char *group2)
+{
+	if (group1 == NULL || group2 == NULL)
+	{
+		return group1 == group2;
+	}
+
+	return strcmp(group1, group2) == 0;
+}
+
+static void push_systable(sysinfo_out_t *out, const systable_t *table)
+{
+	const char *group = NULL;
+	int i = 0;
+
+	for (i = 0; i < table->count; ++i)
+	{
+		const sysentry_t *entry = &table->entries[i];
+
+		if (!same_group(entry->group, group))
+		{
+			if (group != NULL)
+			{
+				out_close(out);
+			}
+
+			group = entry->group;
+
+			if (group != NULL)
+			{
+				out_open(out, group, 0);
+			}
+		}
+
+		out_string(out, entry->key, 0, entry->value);
+	}
+
+	if (group != NULL)
+	{
+		out_close(out);
+	}
+}
+
+static void set_number(lua_State *L, const char *key, double value)
+{
+	lua_pushstring(L, key);
+	lua_pushnumber(L, value);
+	lua_rawset(L, -3);
+}
+
+// subtrees of the table returned by SysInfo() which can be requested separately
+#define SYSINFO_CPU_IDENT             (1 << 0)
+#define SYSINFO_CPU_FEATURES          (1 << 1)
+#define SYSINFO_CPU_EXTENDED_FEATURES (1 << 2)
+#define SYSINFO_CPU_CACHES            (1 << 3)
+#define SYSINFO_CPU_FREQS             (1 << 4)
+#define SYSINFO_SYS                   (1 << 5)
+#define SYSINFO_MEM                   (1 << 6)
+#define SYSINFO_CPU_ISA               (1 << 7)
+
+#define SYSINFO_CPU (SYSINFO_CPU_IDENT | SYSINFO_CPU_FEATURES | SYSINFO_CPU_EXTENDED_FEATURES | SYSINFO_CPU_CACHES | SYSINFO_CPU_FREQS | SYSINFO_CPU_ISA)
+#define SYSINFO_ALL (SYSINFO_CPU | SYSINFO_SYS | SYSINFO_MEM)
+
+typedef struct
+{
+	const char* name;
+	int mask;
+
+} subtree_t;
+
+const subtree_t SysInfoSubtrees[] =
+{
+	{ "cpu",                   SYSINFO_CPU },
+	{ "cpu.ident",             SYSINFO_CPU_IDENT },
+	{ "cpu.features",          SYSINFO_CPU_FEATURES },
+	{ "cpu.extended_features", SYSINFO_CPU_EXTENDED_FEATURES },
+	{ "cpu.caches",            SYSINFO_CPU_CACHES },
+	{ "cpu.freqs",             SYSINFO_CPU_FREQS },
+	{ "cpu.isa",               SYSINFO_CPU_ISA },
+	{ "sys",                   SYSINFO_SYS },
+	{ "mem",                   SYSINFO_MEM },
+	{ NULL,                    0 }
+};
+
+static int subtree_mask(const char *name)
+{
+	const subtree_t *subtree = NULL;
+
+	for (subtree = SysInfoSubtrees; subtree->name != NULL; ++subtree)
+	{
+		if (strcmp(subtree->name, name) == 0)
+		{
+			return subtree->mask;
+		}
+	}
+
+	return 0;
+}
+
+/* Converts the optional SysInfo() argument (a subtree name or a table of subtree names) into a mask */
+static int sysinfo_selection(lua_State *L, int idx, int *selection)
+{
+	int mask = 0;
+
+	*selection = 0;
+
+	switch (lua_type(L, idx))
+	{
+	case LUA_TNONE:
+	case LUA_TNIL:
+		*selection = SYSINFO_ALL;
+		return TRUE;
+
+	case LUA_TSTRING:
+		mask = subtree_mask(lua_tostring(L, idx));
+		if (mask == 0)
+		{
+			return FALSE;
+		}
+		*selection = mask;
+		return TRUE;
+
+	case LUA_TTABLE:
+		lua_pushnil(L);
+		while (lua_next(L, idx) != 0)
+		{
+			mask = (lua_type(L, -1) == LUA_TSTRING) ? subtree_mask(lua_tostring(L, -1)) : 0;
+			lua_pop(L, 1);
+
+			if (mask == 0)
+			{
+				lua_pop(L, 1);
+				return FALSE;
+			}
+
+			*selection |= mask;
+		}
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+static void push_ident(sysinfo_out_t *out)
+{
+	out_open(out, "ident", 0);
+
+	S(vendor)
+	S(processor_brand_string)
 	I(max_standard_cpuid_leaf)
 	I(processor_stepping)
 	I(processor_model)
@@ -811,165 +1577,2709 @@ static SAVEDS int hw_SysInfo(lua_State *L)
 	I(SOC_vendor_ID)
 	//I(processor_serial_number_lo_bits)
 
-	lua_pushstring(L, "Microarchitecture");
-	lua_pushstring(L, microarch_info(processor_model()));
-	lua_rawset(L, -3);
+	out_string(out, "Microarchitecture", 0, microarch_info(processor_model()));
+
+	out_close(out);
+}
+
+/* Adds key = array of the names of supported features reported by leaf 1 (or by all other leaves) */
+static void push_feature_names(sysinfo_out_t *out, const char *key, const feature_set_t *set, int leaf1)
+{
+	int array_index = 0;
+	int i = 0;
+
+	out_open(out, key, 0);
+
+	for (i = 0; i < FEATURES_COUNT; ++i)
+	{
+		if ((Features[i].leaf == 1) == leaf1 && feature_test(set, i))
+		{
+			out_string(out, NULL, array_index, Features[i].name);
+			++array_index;
+		}
+	}
+
+	out_close(out);
+}
+
+static void push_features(sysinfo_out_t *out)
+{
+	push_feature_names(out, "features", feature_set(), TRUE);
+}
+
+static void push_extended_features(sysinfo_out_t *out)
+{
+	push_feature_names(out, "extended_features", feature_set(), FALSE);
+}
+
+static const char *cache_type_name(int type)
+{
+	switch (type)
+	{
+	case CACHE_DATA:        return "data";
+	case CACHE_INSTRUCTION: return "instruction";
+	default:                return "unified";
+	}
+}
+
+#define C(field) out_number(out, #field, cache->field);
+
+/* Adds key = array describing given caches */
+static void push_cache_array(sysinfo_out_t *out, const char *key, const cache_level_t *caches, int count)
+{
+	int i = 0;
+
+	out_open(out, key, 0);
+
+	for (i = 0; i < count; ++i)
+	{
+		const cache_level_t *cache = &caches[i];
+
+		out_open(out, NULL, i);
+
+		C(level)
+		out_string(out, "type", 0, cache_type_name(cache->type));
+		C(size)
+		C(ways)
+		C(line_size)
+		C(sets)
+		C(partitions)
+		C(sharing)
+		out_boolean(out, "inclusive", cache->inclusive);
+
+		if (cache->os_size != 0)
+		{
+			C(os_size)
+		}
+
+		out_close(out);
+	}
+
+	out_close(out);
+}
+
+static void push_cache_levels(sysinfo_out_t *out)
+{
+	cache_level_t caches[MAX_CACHE_LEVELS];
+	int count = cache_hierarchy(caches, MAX_CACHE_LEVELS);
+
+	push_cache_array(out, "levels", caches, count);
+}
+
+static void set_boolean(lua_State *L, const char *key, int value)
+{
+	lua_pushstring(L, key);
+	lua_pushboolean(L, value);
+	lua_rawset(L, -3);
+}
+
+/* Which registers state the OS saves/restores (XCR0) and resulting usable x86-64 level */
+static void push_isa(sysinfo_out_t *out)
+{
+	static const char *LevelNames[] = { "none", "x86-64", "x86-64-v2", "x86-64-v3", "x86-64-v4" };
+	const cpuid_snapshot_t *snap = cpuid_snapshot();
+	int level = isa_level(snap);
+
+	out_open(out, "isa", 0);
+
+	out_boolean(out, "osxsave", snap->xcr0 != 0);
+	out_number(out, "xcr0", (double)snap->xcr0);
+	out_boolean(out, "sse_state", (snap->xcr0 & XCR0_SSE) != 0);
+	out_boolean(out, "avx_state", (snap->xcr0 & XCR0_AVX_STATE) == XCR0_AVX_STATE);
+	out_boolean(out, "avx512_state", (snap->xcr0 & XCR0_AVX512_STATE) == XCR0_AVX512_STATE);
+	out_boolean(out, "amx_state", (snap->xcr0 & XCR0_AMX_STATE) == XCR0_AMX_STATE);
+	out_number(out, "level", level);
+	out_string(out, "level_name", 0, LevelNames[level]);
+
+	out_close(out);
+}
+
+static void push_caches(sysinfo_out_t *out)
+{
+	int array_index = 0;
+
+	out_open(out, "caches", 0);
+
+	I(cache_line_size)
+	I(cache_size)
+	I(processor_cache_line_size)
+
+	get(2);
+
+	if (valid)
+	{
+		if(~eax() & 0x80000000)
+		{
+			add_cache_tlb_info(out, eax() >> 8, &array_index);
+		}
+		if(~ebx() & 0x80000000)
+		{
+			add_cache_tlb_info(out, ebx(), &array_index);
+		}
+		if(~ecx() & 0x80000000)
+		{
+			add_cache_tlb_info(out, ecx(), &array_index);
+		}
+		if(~edx() & 0x80000000)
+		{
+			add_cache_tlb_info(out, edx(), &array_index);
+		}
+	}
+
+	push_cache_levels(out);
+
+	out_close(out);
+}
+
+static void push_freqs(sysinfo_out_t *out)
+{
+	get(0x16);
+
+	if (valid)
+	{
+		out_open(out, "freqs", 0);
+		I(processor_base_frequency_MHz)
+		I(processor_max_frequency_MHz)
+		I(processor_bus_reference_frequency_MHz)
+		out_close(out);
+	}
+}
+
+static void push_sys(sysinfo_out_t *out)
+{
+	out_open(out, "sys", 0);
+
+	push_systable(out, get_systable());
+
+	out_close(out);
+}
+
+/* Adds fields describing memory usage to current table (which, unlike cpu and sys tables, is never cached) */
+static void push_meminfo_fields(sysinfo_out_t *out, const meminfo_t *info)
+{
+	int i = 0;
+
+	out_number(out, "total", (double)info->total);
+	out_number(out, "free", (double)info->free);
+	out_number(out, "available", (double)info->available);
+	out_number(out, "buffers", (double)info->buffers);
+	out_number(out, "cached", (double)info->cached);
+	out_number(out, "swap_total", (double)info->swap_total);
+	out_number(out, "swap_free", (double)info->swap_free);
+
+	out_open(out, "hugepages", 0);
+
+	for (i = 0; i < info->hugepage_sizes; ++i)
+	{
+		out_open(out, NULL, i);
+		out_number(out, "size", (double)info->hugepages[i].size);
+		out_number(out, "total", (double)info->hugepages[i].total);
+		out_number(out, "free", (double)info->hugepages[i].free);
+		out_number(out, "reserved", (double)info->hugepages[i].reserved);
+		out_number(out, "surplus", (double)info->hugepages[i].surplus);
+		out_close(out);
+	}
+
+	out_close(out);
+
+	if (info->transparent_hugepage[0] != '\0')
+	{
+		out_string(out, "transparent_hugepage", 0, info->transparent_hugepage);
+	}
+
+	out_open(out, "nodes", 0);
+
+	for (i = 0; i < info->nodes; ++i)
+	{
+		out_open(out, NULL, i);
+		out_number(out, "node", info->node[i].node);
+		out_number(out, "total", (double)info->node[i].total);
+		out_number(out, "free", (double)info->node[i].free);
+		out_close(out);
+	}
+
+	out_close(out);
+}
+
+/* Pushes a table describing memory usage */
+static void push_meminfo(lua_State *L, const meminfo_t *info)
+{
+	sysinfo_out_t out;
+
+	lua_newtable(L);
+
+	out_lua(&out, L);
+	push_meminfo_fields(&out, info);
+}
+
+static void push_mem(sysinfo_out_t *out)
+{
+	meminfo_t info;
+
+	if (os_meminfo(&info))
+	{
+		out_open(out, "mem", 0);
+		push_meminfo_fields(out, &info);
+		out_close(out);
+	}
+}
+
+/* Adds selected subtrees of the SysInfo() table to out */
+static void sysinfo_collect(sysinfo_out_t *out, int selection)
+{
+	if (selection & SYSINFO_CPU)
+	{
+		out_open(out, "cpu", 0);
+
+		if (selection & SYSINFO_CPU_IDENT)             push_ident(out);
+		if (selection & SYSINFO_CPU_FEATURES)          push_features(out);
+		if (selection & SYSINFO_CPU_EXTENDED_FEATURES) push_extended_features(out);
+		if (selection & SYSINFO_CPU_CACHES)            push_caches(out);
+		if (selection & SYSINFO_CPU_FREQS)             push_freqs(out);
+		if (selection & SYSINFO_CPU_ISA)               push_isa(out);
+
+		out_close(out);
+	}
+
+	if (selection & SYSINFO_SYS)
+	{
+		push_sys(out);
+	}
+
+	if (selection & SYSINFO_MEM)
+	{
+		push_mem(out);
+	}
+}
+
+/* Returns a table containing informations about processor and system
+** An optional subtree name or table of subtree names ("cpu", "cpu.ident", "cpu.features",
+** "cpu.extended_features", "cpu.caches", "cpu.freqs", "cpu.isa", "sys", "mem") restricts what is collected */
+static SAVEDS int hw_SysInfo(lua_State *L)
+{
+	sysinfo_out_t out;
+	int selection = 0;
+
+	if (sysinfo_selection(L, 1, &selection) == FALSE)
+	{
+		return luaL_error(L, "SysInfo() argument must be a subtree name or a table of subtree names");
+	}
+
+	lua_newtable(L);
+
+	out_lua(&out, L);
+	sysinfo_collect(&out, selection);
+
+	return 1;
+
+}
+
+/* Native counterpart of SysInfo() : adds the values of selected subtrees (under the same paths) to a snapshot,
+** then sorts it */
+static void snapshot_collect(snapshot_t *snapshot, int selection)
+{
+	sysinfo_out_t out;
+
+	out_snapshot(&out, snapshot);
+	sysinfo_collect(&out, selection);
+
+	snapshot_sort(snapshot);
+}
+
+static uint64_t times_total(const cpu_times_t *times)
+{
+	return times->user + times->nice + times->system + times->idle + times->iowait + times->irq + times->softirq + times->steal;
+}
+
+/* Difference of two readings of a counter, 0 if it went backwards (iowait may, hot plugged CPUs restart from 0) */
+static uint64_t counter_delta(uint64_t now, uint64_t before)
+{
+	return (now > before) ? now - before : 0;
+}
+
+static void times_delta(const cpu_times_t *now, const cpu_times_t *before, cpu_times_t *delta)
+{
+	delta->cpu     = now->cpu;
+	delta->user    = counter_delta(now->user, before->user);
+	delta->nice    = counter_delta(now->nice, before->nice);
+	delta->system  = counter_delta(now->system, before->system);
+	delta->idle    = counter_delta(now->idle, before->idle);
+	delta->iowait  = counter_delta(now->iowait, before->iowait);
+	delta->irq     = counter_delta(now->irq, before->irq);
+	delta->softirq = counter_delta(now->softirq, before->softirq);
+	delta->steal   = counter_delta(now->steal, before->steal);
+}
+
+/* Computes loads of every processor since previous call (since boot on first call), returns count */
+int cpu_load_sample(cpu_load_state_t *state, cpu_load_t *loads, int max)
+{
+	cpu_times_t *swap = NULL;
+	int count = 0;
+	int i = 0;
+
+	if (state->capacity == 0)
+	{
+		int capacity = os_cpu_count() + 1;
+
+		state->previous = calloc(capacity, sizeof(cpu_times_t));
+		state->current = calloc(capacity, sizeof(cpu_times_t));
+
+		if (state->previous == NULL || state->current == NULL)
+		{
+			cpu_load_free(state);
+			return 0;
+		}
+
+		state->capacity = capacity;
+	}
+
+	count = os_cpu_times(state->current, state->capacity);
+
+	for (i = 0; i < count && i < max; ++i)
+	{
+		static const cpu_times_t zero;
+		const cpu_times_t *now = &state->current[i];
+		const cpu_times_t *before = &zero;
+		cpu_times_t delta;
+		uint64_t total = 0;
+		double scale = 0.0;
+
+		// CPUs going online or offline shift entries
+		if (i < state->previous_count && state->previous[i].cpu == now->cpu)
+		{
+			before = &state->previous[i];
+		}
+
+		times_delta(now, before, &delta);
+		total = times_total(&delta);
+		scale = (total > 0) ? 100.0 / (double)total : 0.0;
+
+		loads[i].cpu    = now->cpu;
+		loads[i].user   = scale * (double)(delta.user + delta.nice);
+		loads[i].system = scale * (double)delta.system;
+		loads[i].iowait = scale * (double)delta.iowait;
+		loads[i].irq    = scale * (double)(delta.irq + delta.softirq);
+		loads[i].steal  = scale * (double)delta.steal;
+		loads[i].idle   = (total > 0) ? scale * (double)delta.idle : 100.0;
+	}
+
+	swap = state->previous;
+	state->previous = state->current;
+	state->current = swap;
+	state->previous_count = count;
+
+	return (count < max) ? count : max;
+}
+
+void cpu_load_free(cpu_load_state_t *state)
+{
+	free(state->previous);
+	free(state->current);
+	memset(state, 0, sizeof(*state));
+}
+
+static cpu_load_state_t cpu_load_state;
+static cpu_load_t *cpu_loads = NULL;
+static int cpu_loads_capacity = 0;
+
+static void push_cpu_load(lua_State *L, const cpu_load_t *load)
+{
+	set_number(L, "user", load->user);
+	set_number(L, "system", load->system);
+	set_number(L, "iowait", load->iowait);
+	set_number(L, "irq", load->irq);
+	set_number(L, "steal", load->steal);
+	set_number(L, "idle", load->idle);
+	set_number(L, "busy", 100.0 - load->idle - load->iowait);
+}
+
+/* Sets total and cpus fields of the table on top of the stack from loads[0] (all processors) and loads[1...] */
+static void push_cpu_loads(lua_State *L, const cpu_load_t *loads, int count)
+{
+	int i = 0;
+
+	lua_pushstring(L, "total");
+	lua_newtable(L);
+	push_cpu_load(L, &loads[0]);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "cpus");
+	lua_newtable(L);
+
+	for (i = 1; i < count; ++i)
+	{
+		lua_pushnumber(L, i - 1);
+		lua_newtable(L);
+		set_number(L, "cpu", loads[i].cpu);
+		push_cpu_load(L, &loads[i]);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+}
+
+/* Sets cpus field of the table on top of the stack from freqs */
+static void push_cpu_freqs(lua_State *L, const cpu_freq_t *freqs, int count)
+{
+	int i = 0;
+
+	lua_pushstring(L, "cpus");
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		set_number(L, "cpu", freqs[i].cpu);
+		set_number(L, "current", freqs[i].cur_khz / 1000.0);
+		set_number(L, "min", freqs[i].min_khz / 1000.0);
+		set_number(L, "max", freqs[i].max_khz / 1000.0);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+}
+
+/* Returns a table describing memory usage (same as SysInfo("mem").mem) */
+static SAVEDS int hw_MemInfo(lua_State *L)
+{
+	meminfo_t info;
+
+	if (os_meminfo(&info) == FALSE)
+	{
+		lua_newtable(L);
+		return 1;
+	}
+
+	push_meminfo(L, &info);
+
+	return 1;
+}
+
+/* Returns total and per processor loads (in percent) since previous call (since boot on first call) */
+static SAVEDS int hw_CPULoad(lua_State *L)
+{
+	int count = 0;
+
+	if (cpu_loads == NULL)
+	{
+		cpu_loads_capacity = os_cpu_count() + 1;
+		cpu_loads = calloc(cpu_loads_capacity, sizeof(cpu_load_t));
+
+		if (cpu_loads == NULL)
+		{
+			cpu_loads_capacity = 0;
+		}
+	}
+
+	count = cpu_load_sample(&cpu_load_state, cpu_loads, cpu_loads_capacity);
+
+	lua_newtable(L);
+
+	if (count == 0)
+	{
+		return 1;
+	}
+
+	push_cpu_loads(L, cpu_loads, count);
+
+	return 1;
+}
+
+static cpu_freq_t *cpu_freqs = NULL;
+static int cpu_freqs_capacity = 0;
+
+/* Returns per processor frequencies (in MHz) reported by the operating system and, unless
+** False is passed, the measured effective frequency of the calling core */
+static SAVEDS int hw_CPUFreq(lua_State *L)
+{
+	int measure = luaL_optnumber(L, 1, 1) != 0;
+	int count = 0;
+
+	if (cpu_freqs == NULL)
+	{
+		cpu_freqs_capacity = os_cpu_count();
+		cpu_freqs = calloc(cpu_freqs_capacity, sizeof(cpu_freq_t));
+
+		if (cpu_freqs == NULL)
+		{
+			cpu_freqs_capacity = 0;
+		}
+	}
+
+	count = os_cpu_freqs(cpu_freqs, cpu_freqs_capacity);
+
+	lua_newtable(L);
+
+	push_cpu_freqs(L, cpu_freqs, count);
+
+	if (measure)
+	{
+		measured_freq_t measured;
+
+		if (measure_frequency(&measured))
+		{
+			set_number(L, "effective", measured.effective_mhz);
+			set_number(L, "tsc", measured.tsc_mhz);
+		}
+	}
+
+	return 1;
+}
+
+/* Returns a high resolution time stamp (see TimerInfo() for its source), convert differences with TicksToNs() */
+static SAVEDS int hw_Ticks(lua_State *L)
+{
+	lua_pushnumber(L, (double)timer_ticks());
+	return 1;
+}
+
+/* Converts a number of ticks (usually a difference between two Ticks() values) into nanoseconds */
+static SAVEDS int hw_TicksToNs(lua_State *L)
+{
+	lua_pushnumber(L, timer_ticks_to_ns(luaL_checknumber(L, 1)));
+	return 1;
+}
+
+/* Returns a table describing the time source behind Ticks() */
+static SAVEDS int hw_TimerInfo(lua_State *L)
+{
+	static const char *Sources[3] = { "clock_gettime", "rdtsc", "rdtscp" };
+	const timer_info_t *timer = timer_get_info();
+
+	lua_newtable(L);
+
+	lua_pushstring(L, "source");
+	lua_pushstring(L, Sources[timer->source]);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "invariant_tsc");
+	lua_pushboolean(L, timer->invariant);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "frequency_source");
+	lua_pushstring(L, timer->frequency_source);
+	lua_rawset(L, -3);
+
+	set_number(L, "frequency", timer->frequency);
+	set_number(L, "resolution_ns", timer->resolution_ns);
+	set_number(L, "overhead_ns", timer->overhead_ns);
+
+	return 1;
+}
+
+static int count_distinct(const int *ids, int count)
+{
+	int distinct = 0;
+	int i = 0;
+	int j = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		for (j = 0; j < i; ++j)
+		{
+			if (ids[j] == ids[i])
+			{
+				break;
+			}
+		}
+
+		if (j == i)
+		{
+			++distinct;
+		}
+	}
+
+	return distinct;
+}
+
+/* Returns the number of online physical cores (logical processors if topology is unknown) */
+int physical_cores(void)
+{
+	logical_cpu_t *cpus = NULL;
+	int count = os_topology(&cpus);
+	int *cores = (count > 0) ? malloc(count * sizeof(int)) : NULL;
+	int online = 0;
+	int i = 0;
+
+	if (cores == NULL)
+	{
+		free(cpus);
+		return os_cpu_count();
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (cpus[i].online)
+		{
+			cores[online++] = ((cpus[i].package & 0x7FF) << 20) | ((cpus[i].die & 0xFF) << 12) | (cpus[i].core & 0xFFF);
+		}
+	}
+
+	count = count_distinct(cores, online);
+
+	free(cores);
+	free(cpus);
+
+	return (count > 0) ? count : os_cpu_count();
+}
+
+#define F(object, field) { lua_pushstring(L, #field); lua_pushnumber(L, (object)->field); lua_rawset(L, -3); }
+
+/* Returns a table describing packages, cores, SMT threads and NUMA nodes of the system */
+static SAVEDS int hw_Topology(lua_State *L)
+{
+	cpuid_topology_t topology;
+	logical_cpu_t *cpus = NULL;
+	int count = os_topology(&cpus);
+	int *packages = NULL;
+	int *cores = NULL;
+	int *nodes = NULL;
+	int online = 0;
+	int i = 0;
+
+	cpuid_topology(cpuid_snapshot(), &topology);
+
+	lua_newtable(L);
+
+	if (count > 0)
+	{
+		packages = malloc(3 * count * sizeof(int));
+	}
+
+	if (packages != NULL)
+	{
+		int packages_count = 0;
+		int cores_count = 0;
+		int nodes_count = 0;
+
+		cores = packages + count;
+		nodes = cores + count;
+
+		for (i = 0; i < count; ++i)
+		{
+			if (cpus[i].online)
+			{
+				packages[online] = cpus[i].package;
+				// cores are only unique within a package (and a die)
+				cores[online] = ((cpus[i].package & 0x7FF) << 20) | ((cpus[i].die & 0xFF) << 12) | (cpus[i].core & 0xFFF);
+				nodes[online] = cpus[i].node;
+				++online;
+			}
+		}
+
+		packages_count = count_distinct(packages, online);
+		cores_count = count_distinct(cores, online);
+		nodes_count = count_distinct(nodes, online);
+
+		set_number(L, "packages", packages_count);
+		set_number(L, "cores", cores_count);
+		set_number(L, "nodes", nodes_count);
+		set_number(L, "online", online);
+		set_number(L, "possible", count);
+
+		free(packages);
+	}
+
+	lua_pushstring(L, "cpuid");
+	lua_newtable(L);
+	F(&topology, source)
+	F(&topology, x2apic_id)
+	F(&topology, smt_shift)
+	F(&topology, core_shift)
+	F(&topology, package_shift)
+	F(&topology, logical_per_core)
+	F(&topology, logical_per_package)
+	if (topology.compute_unit_id >= 0)
+	{
+		F(&topology, compute_unit_id)
+		F(&topology, node_id)
+		F(&topology, nodes_per_package)
+	}
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "cpus");
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		const logical_cpu_t *cpu = &cpus[i];
+
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+
+		F(cpu, cpu)
+
+		lua_pushstring(L, "online");
+		lua_pushboolean(L, cpu->online);
+		lua_rawset(L, -3);
+
+		F(cpu, package)
+		F(cpu, die)
+		F(cpu, core)
+		F(cpu, thread)
+		F(cpu, node)
+		F(cpu, l3_group)
+
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	free(cpus);
+
+	return 1;
+}
+
+/* Returns the number of the logical processor the calling thread is running on (-1 if unknown) */
+static SAVEDS int hw_GetCurrentCPU(lua_State *L)
+{
+	lua_pushnumber(L, os_current_cpu());
+	return 1;
+}
+
+static void push_cpu_list(lua_State *L, const int *cpus, int count)
+{
+	int i = 0;
+
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_pushnumber(L, cpus[i]);
+		lua_rawset(L, -3);
+	}
+}
+
+/* Returns an array of the logical processors the calling thread may run on */
+static SAVEDS int hw_GetAffinity(lua_State *L)
+{
+	int possible = os_cpu_count();
+	int *cpus = malloc((possible + 1) * sizeof(int));
+	int count = 0;
+
+	if (cpus == NULL)
+	{
+		return luaL_error(L, "GetAffinity() is out of memory");
+	}
+
+	count = os_get_affinity(cpus, possible);
+	push_cpu_list(L, cpus, count);
+	free(cpus);
+
+	return 1;
+}
+
+/* Restricts the calling thread to the logical processors of given array, returns True on success */
+static SAVEDS int hw_SetAffinity(lua_State *L)
+{
+	int capacity = 0;
+	int count = 0;
+	int *cpus = NULL;
+	int result = FALSE;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	lua_pushnil(L);
+
+	while (lua_next(L, 1) != 0)
+	{
+		if (lua_type(L, -1) != LUA_TNUMBER)
+		{
+			free(cpus);
+			return luaL_error(L, "SetAffinity() argument must be an array of processor numbers");
+		}
+
+		if (count == capacity)
+		{
+			int *grown = NULL;
+
+			capacity = (capacity == 0) ? 16 : 2 * capacity;
+			grown = realloc(cpus, capacity * sizeof(int));
+
+			if (grown == NULL)
+			{
+				free(cpus);
+				return luaL_error(L, "SetAffinity() is out of memory");
+			}
+
+			cpus = grown;
+		}
+
+		cpus[count++] = (int)lua_tonumber(L, -1);
+		lua_pop(L, 1);
+	}
+
+	if (count > 0)
+	{
+		result = os_set_affinity(cpus, count);
+	}
+
+	free(cpus);
+
+	lua_pushboolean(L, result);
+	return 1;
+}
+
+// placement classes, best first
+#define PLACE_CORE         0    // first thread of a core
+#define PLACE_CPU0         1    // CPU 0 (usually busier with interrupts and housekeeping)
+#define PLACE_SIBLING      2    // other threads of a core
+#define PLACE_CPU0_SIBLING 3    // other threads of CPU 0 core
+
+/* One candidate logical processor for a worker */
+typedef struct
+{
+	int cpu;
+	int place;
+	int node_rank;      // 0 for the NUMA node having the most cores available
+	int l3_group;
+
+} placement_t;
+
+static int compare_placements(const void *placement1, const void *placement2)
+{
+	const placement_t *p1 = (const placement_t *)placement1;
+	const placement_t *p2 = (const placement_t *)placement2;
+
+	if (p1->place != p2->place)         return p1->place - p2->place;
+	if (p1->node_rank != p2->node_rank) return p1->node_rank - p2->node_rank;
+	if (p1->l3_group != p2->l3_group)   return p1->l3_group - p2->l3_group;
+
+	return p1->cpu - p2->cpu;
+}
+
+static int core_key(const logical_cpu_t *cpu)
+{
+	// same key as hw_Topology()
+	return ((cpu->package & 0x7FF) << 20) | ((cpu->die & 0xFF) << 12) | (cpu->core & 0xFFF);
+}
+
+/* Fills placements with every logical processor the calling thread may run on, best ones for workers first,
+** returns count */
+static int recommend_cpus(placement_t *placements, int possible)
+{
+	logical_cpu_t *cpus = NULL;
+	int count = os_topology(&cpus);
+	int *allowed = calloc(possible + 1, sizeof(int));
+	char *usable = calloc(possible + 1, 1);
+	int *node_cores = NULL;
+	int allowed_count = 0;
+	int cpu0_core = -1;
+	int placed = 0;
+	int i = 0;
+
+	if (allowed == NULL || usable == NULL)
+	{
+		free(allowed);
+		free(usable);
+		free(cpus);
+		return 0;
+	}
+
+	allowed_count = os_get_affinity(allowed, possible);
+
+	for (i = 0; i < allowed_count; ++i)
+	{
+		usable[allowed[i]] = TRUE;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (cpus[i].cpu == 0)
+		{
+			cpu0_core = core_key(&cpus[i]);
+		}
+	}
+
+	// without topology, all allowed processors are cores
+	if (count == 0)
+	{
+		for (i = 0; i < allowed_count; ++i)
+		{
+			placements[placed].cpu = allowed[i];
+			placements[placed].place = (allowed[i] == 0) ? PLACE_CPU0 : PLACE_CORE;
+			placements[placed].node_rank = 0;
+			placements[placed].l3_group = 0;
+			++placed;
+		}
+	}
+	else
+	{
+		node_cores = calloc(possible + 1, sizeof(int));
+	}
+
+	if (node_cores != NULL)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			const logical_cpu_t *cpu = &cpus[i];
+			int core = core_key(cpu);
+
+			if (!cpu->online || cpu->cpu < 0 || cpu->cpu >= possible || !usable[cpu->cpu])
+			{
+				continue;
+			}
+
+			if (cpu->cpu == 0)
+			{
+				placements[placed].place = PLACE_CPU0;
+			}
+			else if (core == cpu0_core)
+			{
+				placements[placed].place = PLACE_CPU0_SIBLING;
+			}
+			else
+			{
+				placements[placed].place = (cpu->thread > 0) ? PLACE_SIBLING : PLACE_CORE;
+			}
+
+			if (placements[placed].place == PLACE_CORE && cpu->node >= 0 && cpu->node < possible)
+			{
+				++node_cores[cpu->node];
+			}
+
+			placements[placed].cpu = cpu->cpu;
+			placements[placed].node_rank = (cpu->node >= 0 && cpu->node < possible) ? cpu->node : 0;
+			placements[placed].l3_group = cpu->l3_group;
+			++placed;
+		}
+
+		// nodes are ranked by available cores (lower node first on ties)
+		for (i = 0; i < placed; ++i)
+		{
+			int node = placements[i].node_rank;
+			int rank = 0;
+			int other = 0;
+
+			for (other = 0; other < possible; ++other)
+			{
+				if (node_cores[other] > node_cores[node] || (node_cores[other] == node_cores[node] && other < node))
+				{
+					++rank;
+				}
+			}
+
+			placements[i].node_rank = rank;
+		}
+
+		free(node_cores);
+	}
+
+	qsort(placements, placed, sizeof(placement_t), compare_placements);
+
+	free(allowed);
+	free(usable);
+	free(cpus);
+
+	return placed;
+}
+
+/* Fills cpus with at most max logical processors for worker threads (best first), returns count (-1 if out of memory) */
+int recommended_cpus(int *cpus, int max)
+{
+	int possible = os_cpu_count();
+	placement_t *placements = malloc((possible + 1) * sizeof(placement_t));
+	int count = 0;
+	int i = 0;
+
+	if (placements == NULL)
+	{
+		return -1;
+	}
+
+	count = recommend_cpus(placements, possible);
+
+	for (i = 0; i < count && i < max; ++i)
+	{
+		cpus[i] = placements[i].cpu;
+	}
+
+	free(placements);
+
+	return i;
+}
+
+/* Returns an array of logical processors for workers threads : one per physical core, on the NUMA node having
+** the most available cores, leaving CPU 0 and SMT siblings for last */
+static SAVEDS int hw_RecommendCPUs(lua_State *L)
+{
+	int workers = (int)luaL_checknumber(L, 1);
+	int *cpus = NULL;
+	int count = 0;
+	int i = 0;
+
+	if (workers < 1)
+	{
+		return luaL_error(L, "RecommendCPUs() needs at least one worker");
+	}
+
+	// never more than one worker per logical processor
+	if (workers > os_cpu_count())
+	{
+		workers = os_cpu_count();
+	}
+
+	cpus = malloc(workers * sizeof(int));
+	count = (cpus != NULL) ? recommended_cpus(cpus, workers) : -1;
+
+	if (count < 0)
+	{
+		free(cpus);
+		return luaL_error(L, "RecommendCPUs() is out of memory");
+	}
+
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_pushnumber(L, cpus[i]);
+		lua_rawset(L, -3);
+	}
+
+	free(cpus);
+
+	return 1;
+}
+
+static const char *core_class(uint32_t core_type)
+{
+	switch (core_type)
+	{
+	case 0:              return "uniform";
+	case CORE_TYPE_CORE: return "performance";
+	case CORE_TYPE_ATOM: return "efficiency";
+	default:             return "unknown";
+	}
+}
+
+/* Pushes fields shared by a processor and a kind of core into the table on top of the stack */
+static void push_core_identity(lua_State *L, const cpu_identity_t *identity)
+{
+	sysinfo_out_t out;
+
+	set_number(L, "core_type", identity->core_type);
+
+	lua_pushstring(L, "core_class");
+	lua_pushstring(L, core_class(identity->core_type));
+	lua_rawset(L, -3);
+
+	set_number(L, "native_model_id", identity->native_model);
+	set_number(L, "signature", identity->signature);
+
+	out_lua(&out, L);
+	push_cache_array(&out, "caches", identity->caches, identity->cache_count);
+	push_feature_names(&out, "features", &identity->features, TRUE);
+	push_feature_names(&out, "extended_features", &identity->features, FALSE);
+}
+
+static int same_core(const cpu_identity_t *identity1, const cpu_identity_t *identity2)
+{
+	return identity1->core_type == identity2->core_type && identity1->native_model == identity2->native_model &&
+		identity1->signature == identity2->signature &&
+		memcmp(&identity1->features, &identity2->features, sizeof(feature_set_t)) == 0;
+}
+
+/* Returns CPUID identity of every logical processor (run from a thread pinned on each one, so that hybrid
+** processors show their performance and efficiency cores) and the distinct kinds of cores found */
+static SAVEDS int hw_CoreTypes(lua_State *L)
+{
+	cpu_identity_t *identities = NULL;
+	int count = cpu_identities(&identities);
+	int types = 0;
+	int i = 0;
+	int j = 0;
+
+	lua_newtable(L);
+
+	set_boolean(L, "hybrid", feature_test(feature_set(), FEATURE_HYBRID));
+
+	lua_pushstring(L, "cpus");
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		set_number(L, "cpu", identities[i].cpu);
+		set_boolean(L, "pinned", identities[i].pinned);
+		push_core_identity(L, &identities[i]);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "types");
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		int cpus = 0;
+
+		// first processor of its kind only
+		for (j = 0; j < i && !same_core(&identities[j], &identities[i]); ++j)
+		{
+		}
+
+		if (j < i)
+		{
+			continue;
+		}
+
+		lua_pushnumber(L, types++);
+		lua_newtable(L);
+		push_core_identity(L, &identities[i]);
+
+		lua_pushstring(L, "cpus");
+		lua_newtable(L);
+
+		for (j = i; j < count; ++j)
+		{
+			if (same_core(&identities[j], &identities[i]))
+			{
+				lua_pushnumber(L, cpus++);
+				lua_pushnumber(L, identities[j].cpu);
+				lua_rawset(L, -3);
+			}
+		}
+
+		lua_rawset(L, -3);
+
+		set_number(L, "count", cpus);
+
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	free(identities);
+
+	return 1;
+}
+
+static void set_text(lua_State *L, const char *key, const char *value)
+{
+	lua_pushstring(L, key);
+	lua_pushstring(L, value);
+	lua_rawset(L, -3);
+}
+
+/* Returns an array describing each block device (size and sizes of blocks in bytes) */
+static SAVEDS int hw_Disks(lua_State *L)
+{
+	disk_info_t *disks = NULL;
+	int count = os_disks(&disks);
+	int i = 0;
+
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		const disk_info_t *disk = &disks[i];
+
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		set_text(L, "name", disk->name);
+		set_text(L, "model", disk->model);
+		set_number(L, "size", (double)disk->size);
+		set_boolean(L, "rotational", disk->rotational);
+		set_boolean(L, "removable", disk->removable);
+		set_number(L, "logical_block_size", disk->logical_block_size);
+		set_number(L, "physical_block_size", disk->physical_block_size);
+		set_number(L, "queue_depth", disk->queue_depth);
+		set_number(L, "nr_requests", disk->nr_requests);
+		set_text(L, "scheduler", disk->scheduler);
+		set_number(L, "read_ahead", disk->read_ahead);
+		lua_rawset(L, -3);
+	}
+
+	free(disks);
+
+	return 1;
+}
+
+/* Counters of the previous DiskStats() call, sorted as os_disk_counters() returned them */
+typedef struct
+{
+	disk_counters_t *counters;
+	int count;
+	double time;
+
+} disk_stats_state_t;
+
+static disk_stats_state_t disk_stats_state;
+static disk_counters_t *disk_counters = NULL;
+
+/* Returns the previous counters of a device, or NULL if it wasn't there (first call or hot plugged) */
+static const disk_counters_t *previous_counters(const disk_stats_state_t *state, const char *name, int hint)
+{
+	int i = 0;
+
+	// devices are usually listed in the same order
+	if (hint < state->count && strcmp(state->counters[hint].name, name) == 0)
+	{
+		return &state->counters[hint];
+	}
+
+	for (i = 0; i < state->count; ++i)
+	{
+		if (strcmp(state->counters[i].name, name) == 0)
+		{
+			return &state->counters[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* TRUE if a counter went backwards : the device has been removed and added again, or 32 bits counters wrapped */
+static int disk_counters_restarted(const disk_counters_t *current, const disk_counters_t *previous)
+{
+	return current->reads < previous->reads || current->read_sectors < previous->read_sectors ||
+		current->read_ms < previous->read_ms || current->writes < previous->writes ||
+		current->write_sectors < previous->write_sectors || current->write_ms < previous->write_ms ||
+		current->io_ms < previous->io_ms || current->queue_ms < previous->queue_ms;
+}
+
+static void push_disk_stats(lua_State *L, const disk_counters_t *current, const disk_counters_t *previous, double elapsed)
+{
+	disk_counters_t boot;
+	uint64_t reads = 0;
+	uint64_t writes = 0;
+	uint64_t ios = 0;
+
+	// counted from 0 then
+	if (previous == NULL || disk_counters_restarted(current, previous))
+	{
+		memset(&boot, 0, sizeof(boot));
+		previous = &boot;
+	}
+
+	reads = current->reads - previous->reads;
+	writes = current->writes - previous->writes;
+	ios = reads + writes;
+
+	set_text(L, "name", current->name);
+	set_number(L, "read_bytes", (current->read_sectors - previous->read_sectors) * 512.0 / elapsed);
+	set_number(L, "write_bytes", (current->write_sectors - previous->write_sectors) * 512.0 / elapsed);
+	set_number(L, "read_iops", reads / elapsed);
+	set_number(L, "write_iops", writes / elapsed);
+	set_number(L, "await", (ios > 0) ? (double)(current->read_ms - previous->read_ms + current->write_ms - previous->write_ms) / ios : 0.0);
+	set_number(L, "queue_size", (current->queue_ms - previous->queue_ms) / (elapsed * 1000.0));
+	set_number(L, "busy", (current->io_ms - previous->io_ms) / (elapsed * 10.0));
+	set_number(L, "in_flight", (double)current->in_flight);
+}
+
+/* Returns per device throughputs (bytes/s), IOPS and average times (ms) since previous call (since boot on first call) */
+static SAVEDS int hw_DiskStats(lua_State *L)
+{
+	disk_stats_state_t *state = &disk_stats_state;
+	disk_counters_t *swap = NULL;
+	double now = monotonic_seconds();
+	double elapsed = 0.0;
+	int count = 0;
+	int i = 0;
+
+	if (state->counters == NULL)
+	{
+		state->counters = calloc(MAX_DISKS, sizeof(disk_counters_t));
+		disk_counters = calloc(MAX_DISKS, sizeof(disk_counters_t));
+
+		if (state->counters == NULL || disk_counters == NULL)
+		{
+			free(state->counters);
+			free(disk_counters);
+			state->counters = NULL;
+			disk_counters = NULL;
+			lua_newtable(L);
+			return 1;
+		}
+	}
+
+	count = os_disk_counters(disk_counters, MAX_DISKS);
+	elapsed = (state->time > 0.0) ? now - state->time : now;
+
+	lua_newtable(L);
+	set_number(L, "interval", elapsed);
+
+	lua_pushstring(L, "disks");
+	lua_newtable(L);
+
+	for (i = 0; i < count && elapsed > 0.0; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		push_disk_stats(L, &disk_counters[i], previous_counters(state, disk_counters[i].name, i), elapsed);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	// current counters become previous ones
+	swap = state->counters;
+	state->counters = disk_counters;
+	disk_counters = swap;
+	state->count = count;
+	state->time = now;
+
+	return 1;
+}
+
+/* Returns a numeric field of the table at idx, or fallback if it is missing */
+static double get_number_field(lua_State *L, int idx, const char *key, double fallback)
+{
+	double value = fallback;
+
+	if (lua_type(L, idx) != LUA_TTABLE)
+	{
+		return fallback;
+	}
+
+	lua_pushstring(L, key);
+	lua_rawget(L, idx);
+
+	if (lua_type(L, -1) == LUA_TNUMBER)
+	{
+		value = lua_tonumber(L, -1);
+	}
+
+	lua_pop(L, 1);
+
+	return value;
+}
+
+static void push_bench_stats(lua_State *L, const bench_stat_t *stats)
+{
+	static const char *Kernels[BENCH_KERNELS] = { "copy", "scale", "add", "triad" };
+	int kernel = 0;
+
+	lua_newtable(L);
+
+	for (kernel = 0; kernel < BENCH_KERNELS; ++kernel)
+	{
+		lua_pushstring(L, Kernels[kernel]);
+		lua_newtable(L);
+		set_number(L, "min", stats[kernel].min);
+		set_number(L, "median", stats[kernel].median);
+		set_number(L, "max", stats[kernel].max);
+		lua_rawset(L, -3);
+	}
+}
+
+/* Runs a STREAM-like memory bandwidth benchmark, returns GB/s of each kernel single and multi-threaded
+** Optional table argument : size (bytes per array), repetitions, threads */
+static SAVEDS int hw_BenchMemory(lua_State *L)
+{
+	bench_memory_t bench;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.size = (size_t)get_number_field(L, 1, "size", 0);
+	bench.repetitions = (int)get_number_field(L, 1, "repetitions", 0);
+	bench.threads = (int)get_number_field(L, 1, "threads", 0);
+
+	if (bench_memory(&bench) == FALSE)
+	{
+		return luaL_error(L, "BenchMemory() couldn't allocate %d MB of memory or start %d threads", (int)(3 * bench.size / (1024 * 1024)), bench.threads);
+	}
+
+	lua_newtable(L);
+
+	set_number(L, "size", (double)bench.size);
+	set_number(L, "repetitions", bench.repetitions);
+	set_number(L, "threads", bench.threads);
+
+	lua_pushstring(L, "single");
+	push_bench_stats(L, bench.single);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "multi");
+	push_bench_stats(L, bench.multi);
+	lua_rawset(L, -3);
+
+	return 1;
+}
+
+/* Measures load-to-use latency with a randomized pointer chasing cycle over growing working sets
+** Optional argument : largest working set in bytes */
+static SAVEDS int hw_BenchLatency(lua_State *L)
+{
+	static const char *Levels[] = { "dram", "l1", "l2", "l3", "l4" };
+	bench_latency_t *bench = calloc(1, sizeof(bench_latency_t));
+	int i = 0;
+
+	if (bench == NULL)
+	{
+		return luaL_error(L, "BenchLatency() is out of memory");
+	}
+
+	bench->max_size = (size_t)luaL_optnumber(L, 1, 0);
+
+	if (bench_latency(bench) == FALSE)
+	{
+		size_t max_size = bench->max_size;
+
+		free(bench);
+		return luaL_error(L, "BenchLatency() couldn't allocate %d MB of memory", (int)(max_size / (1024 * 1024)));
+	}
+
+	lua_newtable(L);
+
+	set_number(L, "line_size", bench->line_size);
+	set_number(L, "max_size", (double)bench->max_size);
+	set_number(L, "core_mhz", bench->core_mhz);
+
+	lua_pushstring(L, "points");
+	lua_newtable(L);
+
+	for (i = 0; i < bench->count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		set_number(L, "size", (double)bench->points[i].size);
+		set_number(L, "ns", bench->points[i].ns);
+		set_number(L, "cycles", bench->points[i].cycles);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "plateaus");
+	lua_newtable(L);
+
+	for (i = 0; i < bench->plateaus_count; ++i)
+	{
+		const latency_plateau_t *plateau = &bench->plateaus[i];
+
+		lua_pushnumber(L, i);
+		lua_newtable(L);
+		lua_pushstring(L, "level");
+		lua_pushstring(L, (plateau->level < (int)(sizeof(Levels) / sizeof(Levels[0]))) ? Levels[plateau->level] : "?");
+		lua_rawset(L, -3);
+		set_number(L, "cache_size", (double)plateau->cache_size);
+		set_number(L, "size", (double)plateau->size);
+		set_number(L, "ns", plateau->ns);
+		set_number(L, "cycles", plateau->cycles);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	free(bench);
+
+	return 1;
+}
+
+/* Returns True if the processor has given feature (name as in cpu.features/extended_features) */
+static SAVEDS int hw_HasFeature(lua_State *L)
+{
+	int id = feature_lookup(luaL_checklstring(L, 1, NULL));
+
+	lua_pushboolean(L, id >= 0 && feature_test(feature_set(), id));
+
+	return 1;
+}
+
+/* Returns True if the processor has all features of given table */
+static SAVEDS int hw_HasFeatures(lua_State *L)
+{
+	const feature_set_t *set = feature_set();
+	int result = TRUE;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	lua_pushnil(L);
+	while (lua_next(L, 1) != 0)
+	{
+		int id = (lua_type(L, -1) == LUA_TSTRING) ? feature_lookup(lua_tostring(L, -1)) : -1;
+
+		lua_pop(L, 1);
+
+		if (id < 0 || !feature_test(set, id))
+		{
+			lua_pop(L, 1);
+			result = FALSE;
+			break;
+		}
+	}
+
+	lua_pushboolean(L, result);
+
+	return 1;
+}
+
+/* Returns resources used by the current process : cheap enough to be called every frame */
+static SAVEDS int hw_ProcessInfo(lua_State *L)
+{
+	process_info_t info;
+
+	lua_newtable(L);
+
+	if (os_process_info(&info) == FALSE)
+	{
+		return 1;
+	}
+
+	F(&info, user_time)
+	F(&info, system_time)
+	F(&info, virtual_size)
+	F(&info, rss)
+	F(&info, peak_rss)
+	F(&info, shared)
+	F(&info, text)
+	F(&info, data)
+	F(&info, swap)
+	F(&info, minor_faults)
+	F(&info, major_faults)
+	F(&info, voluntary_switches)
+	F(&info, involuntary_switches)
+	F(&info, threads)
+
+	if (info.io)
+	{
+		lua_pushstring(L, "io");
+		lua_newtable(L);
+		F(&info, read_chars)
+		F(&info, write_chars)
+		F(&info, read_syscalls)
+		F(&info, write_syscalls)
+		F(&info, read_bytes)
+		F(&info, write_bytes)
+		lua_rawset(L, -3);
+	}
+
+	return 1;
+}
+
+typedef struct
+{
+	const char *name;
+	int mask;
+
+} monitor_metric_t;
+
+static const monitor_metric_t MonitorMetrics[] =
+{
+	{ "cpu",  MONITOR_CPU },
+	{ "mem",  MONITOR_MEM },
+	{ "freq", MONITOR_FREQ },
+	{ NULL,   0 }
+};
+
+static int monitor_mask(const char *name)
+{
+	const monitor_metric_t *metric = NULL;
+
+	for (metric = MonitorMetrics; metric->name != NULL; ++metric)
+	{
+		if (strcmp(metric->name, name) == 0)
+		{
+			return metric->mask;
+		}
+	}
+
+	return 0;
+}
+
+/* Starts (or restarts) sampling in a native thread
+** Optional table argument : interval (in milliseconds, default 1000), what (table of "cpu", "mem", "freq", default all),
+** history (seconds kept for GetHistory(), default 60) */
+static SAVEDS int hw_StartMonitor(lua_State *L)
+{
+	double interval = get_number_field(L, 1, "interval", 1000.0);
+	double history = get_number_field(L, 1, "history", 60.0);
+	int what = 0;
+
+	if (interval < 1.0)
+	{
+		return luaL_error(L, "StartMonitor() interval must be at least 1 ms");
+	}
+
+	if (lua_type(L, 1) == LUA_TTABLE)
+	{
+		lua_pushstring(L, "what");
+		lua_rawget(L, 1);
+
+		if (lua_type(L, -1) == LUA_TTABLE)
+		{
+			int table = lua_gettop(L);
+
+			lua_pushnil(L);
+			while (lua_next(L, table) != 0)
+			{
+				int mask = (lua_type(L, -1) == LUA_TSTRING) ? monitor_mask(lua_tostring(L, -1)) : 0;
+
+				lua_pop(L, 1);
+
+				if (mask == 0)
+				{
+					return luaL_error(L, "StartMonitor() what must only contain \"cpu\", \"mem\" or \"freq\"");
+				}
+
+				what |= mask;
+			}
+		}
+
+		lua_pop(L, 1);
+	}
+
+	if (monitor_start(interval / 1000.0, what ? what : MONITOR_ALL, history) == FALSE)
+	{
+		return luaL_error(L, "StartMonitor() couldn't start sampling thread");
+	}
+
+	return 0;
+}
+
+/* Returns latest sample of the monitor (empty table if none yet), only copies memory : never waits for the sampler */
+static SAVEDS int hw_GetLatest(lua_State *L)
+{
+	const monitor_snapshot_t *snapshot = monitor_latest();
+
+	lua_newtable(L);
+
+	if (snapshot == NULL)
+	{
+		return 1;
+	}
+
+	set_number(L, "time", snapshot->time);
+	set_number(L, "index", snapshot->index);
+
+	if (snapshot->what & MONITOR_CPU)
+	{
+		lua_pushstring(L, "cpu");
+		lua_newtable(L);
+		push_cpu_loads(L, snapshot->cpus, snapshot->cpu_count);
+		lua_rawset(L, -3);
+	}
+
+	if (snapshot->what & MONITOR_MEM)
+	{
+		lua_pushstring(L, "mem");
+		push_meminfo(L, &snapshot->mem);
+		lua_rawset(L, -3);
+	}
+
+	if (snapshot->what & MONITOR_FREQ)
+	{
+		lua_pushstring(L, "freq");
+		lua_newtable(L);
+		push_cpu_freqs(L, snapshot->freqs, snapshot->freq_count);
+		lua_rawset(L, -3);
+	}
+
+	return 1;
+}
+
+static const char *MetricNames[METRICS] = { "cpu", "mem", "swap", "freq" };
+
+static void push_array(lua_State *L, const char *key, const double *values, int count)
+{
+	int i = 0;
+
+	lua_pushstring(L, key);
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		lua_pushnumber(L, i);
+		lua_pushnumber(L, values[i]);
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+}
+
+/* Returns samples of a metric taken by the monitor during the last seconds (all kept ones by default)
+** as flat arrays, plus aggregates over the whole kept history */
+static SAVEDS int hw_GetHistory(lua_State *L)
+{
+	const char *name = luaL_checklstring(L, 1, NULL);
+	double seconds = luaL_optnumber(L, 2, 1e30);
+	const double *times = NULL;
+	const double *values = NULL;
+	history_stats_t stats;
+	int metric = 0;
+	int count = 0;
+
+	for (metric = 0; metric < METRICS; ++metric)
+	{
+		if (strcmp(MetricNames[metric], name) == 0)
+		{
+			break;
+		}
+	}
+
+	if (metric == METRICS)
+	{
+		return luaL_error(L, "GetHistory() metric must be \"cpu\", \"mem\", \"swap\" or \"freq\"");
+	}
+
+	count = monitor_history(metric, seconds, &times, &values, &stats);
+
+	lua_newtable(L);
+
+	set_number(L, "count", count);
+	push_array(L, "time", times, count);
+	push_array(L, "value", values, count);
+
+	if (stats.count > 0)
+	{
+		set_number(L, "samples", stats.count);
+		set_number(L, "min", stats.min);
+		set_number(L, "max", stats.max);
+		set_number(L, "mean", stats.mean);
+		set_number(L, "p50", stats.p50);
+		set_number(L, "p95", stats.p95);
+		set_number(L, "p99", stats.p99);
+	}
+
+	return 1;
+}
+
+/* Stops the sampling thread */
+static SAVEDS int hw_StopMonitor(lua_State *L)
+{
+	monitor_stop();
+
+	return 0;
+}
+
+static const char *PerfNames[PERF_COUNTERS] =
+{
+	"cycles", "instructions", "cache_references", "cache_misses", "branch_misses", "task_clock_ns", "context_switches"
+};
+
+/* Starts counting hardware events (and time) of the calling thread for given region */
+static SAVEDS int hw_PerfBegin(lua_State *L)
+{
+	if (perf_begin(luaL_checklstring(L, 1, NULL)) == FALSE)
+	{
+		return luaL_error(L, "PerfBegin() is out of memory");
+	}
+
+	return 0;
+}
+
+/* Stops counting for given region and adds counters to its totals */
+static SAVEDS int hw_PerfEnd(lua_State *L)
+{
+	const char *name = luaL_checklstring(L, 1, NULL);
+
+	if (perf_end(name) == FALSE)
+	{
+		return luaL_error(L, "PerfEnd() : region \"%s\" has not been started with PerfBegin()", name);
+	}
+
+	return 0;
+}
+
+/* Returns totals of each region with derived ratios, optional argument resets totals once returned */
+static SAVEDS int hw_PerfReport(lua_State *L)
+{
+	int reset = luaL_optnumber(L, 1, 0) != 0;
+	uint32_t available = perf_counters();
+	int count = 0;
+	const perf_region_t *regions = perf_regions(&count);
+	int i = 0;
+	int j = 0;
+
+	lua_newtable(L);
+
+	lua_pushstring(L, "counters");
+	lua_newtable(L);
+
+	for (j = 0; j < PERF_COUNTERS; ++j)
+	{
+		set_boolean(L, PerfNames[j], (available >> j) & 1);
+	}
+
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "regions");
+	lua_newtable(L);
+
+	for (i = 0; i < count; ++i)
+	{
+		const perf_region_t *region = &regions[i];
+		const uint64_t *totals = region->totals;
+
+		lua_pushstring(L, region->name);
+		lua_newtable(L);
+
+		set_number(L, "calls", region->calls);
+		set_number(L, "time_ns", region->elapsed_ns);
+
+		for (j = 0; j < PERF_COUNTERS; ++j)
+		{
+			if ((available >> j) & 1)
+			{
+				set_number(L, PerfNames[j], (double)totals[j]);
+			}
+		}
+
+		if ((available & (1 << PERF_CYCLES)) && (available & (1 << PERF_INSTRUCTIONS)) && totals[PERF_CYCLES] > 0)
+		{
+			set_number(L, "ipc", (double)totals[PERF_INSTRUCTIONS] / totals[PERF_CYCLES]);
+		}
+
+		if ((available & (1 << PERF_CACHE_MISSES)) && (available & (1 << PERF_CACHE_REFERENCES)) && totals[PERF_CACHE_REFERENCES] > 0)
+		{
+			set_number(L, "cache_miss_rate", (double)totals[PERF_CACHE_MISSES] / totals[PERF_CACHE_REFERENCES]);
+		}
+
+		if ((available & (1 << PERF_BRANCH_MISSES)) && (available & (1 << PERF_INSTRUCTIONS)) && totals[PERF_INSTRUCTIONS] > 0)
+		{
+			set_number(L, "branch_misses_per_kinstr", 1000.0 * totals[PERF_BRANCH_MISSES] / totals[PERF_INSTRUCTIONS]);
+		}
+
+		lua_rawset(L, -3);
+	}
+
+	lua_rawset(L, -3);
+
+	if (reset)
+	{
+		perf_reset();
+	}
+
+	return 1;
+}
+
+/* Writes SysInfo() (or the given subtrees of it) to a file as JSON or as a binary snapshot readable by Import(),
+** returns the number of values written */
+static SAVEDS int hw_Export(lua_State *L)
+{
+	const char *filename = luaL_checklstring(L, 1, NULL);
+	const char *format = luaL_optlstring(L, 2, "json", NULL);
+	int selection = 0;
+	int binary = FALSE;
+	int written = FALSE;
+	uint32_t count = 0;
+	snapshot_t snapshot;
+
+	if (strcmp(format, "binary") == 0)
+	{
+		binary = TRUE;
+	}
+	else if (strcmp(format, "json") != 0)
+	{
+		return luaL_error(L, "Export() format must be \"json\" or \"binary\"");
+	}
+
+	if (sysinfo_selection(L, 3, &selection) == FALSE)
+	{
+		return luaL_error(L, "Export() subtrees must be a subtree name or a table of subtree names");
+	}
+
+	snapshot_init(&snapshot);
+	snapshot_collect(&snapshot, selection);
+
+	written = binary ? snapshot_write_binary(&snapshot, filename) : snapshot_write_json(&snapshot, filename);
+	count = snapshot.count;
+	snapshot_free(&snapshot);
+
+	if (!written)
+	{
+		return luaL_error(L, "Export() couldn't write \"%s\"", filename);
+	}
+
+	lua_pushnumber(L, count);
+	return 1;
+}
+
+static void push_segment(lua_State *L, const char *segment, uint32_t length)
+{
+	if (snapshot_numeric(segment, length))
+	{
+		lua_pushnumber(L, strtoul(segment, NULL, 10));
+	}
+	else
+	{
+		lua_pushlstring(L, segment, length);
+	}
+}
+
+static void push_record(lua_State *L, const snapshot_t *snapshot, const snaprecord_t *record)
+{
+	const char *text = NULL;
+
+	switch (record->type)
+	{
+	case SNAPSHOT_NUMBER:
+		lua_pushnumber(L, record->value.number);
+		break;
+
+	case SNAPSHOT_STRING:
+		text = snapshot_text(snapshot, record->value.string.offset, record->value.string.length);
+		lua_pushlstring(L, (text != NULL) ? text : "", (text != NULL) ? record->value.string.length : 0);
+		break;
+
+	case SNAPSHOT_BOOLEAN:
+		lua_pushboolean(L, record->value.boolean != 0);
+		break;
+
+	case SNAPSHOT_EMPTY:
+		lua_newtable(L);
+		break;
+
+	default:
+		lua_pushnil(L);
+		break;
+	}
+}
+
+static void table_open(void *context, const char *key, uint32_t length, int array)
+{
+	lua_State *L = (lua_State *)context;
+
+	push_segment(L, key, length);
+	lua_newtable(L);
+}
+
+static void table_close(void *context, int array)
+{
+	lua_rawset((lua_State *)context, -3);
+}
+
+static void table_value(void *context, const char *key, uint32_t length, const snapshot_t *snapshot, const snaprecord_t *record)
+{
+	lua_State *L = (lua_State *)context;
+
+	push_segment(L, key, length);
+	push_record(L, snapshot, record);
+	lua_rawset(L, -3);
+}
+
+/* Reads back a file written by Export(path, "binary") : the whole table or only the value or subtree at
+** given path ("cpu.caches", "sys.bios_vendor", ...), nil if there is nothing at this path */
+static SAVEDS int hw_Import(lua_State *L)
+{
+	static const snapshot_visitor_t TableVisitor = { table_open, table_close, table_value };
+	const char *filename = luaL_checklstring(L, 1, NULL);
+	const char *prefix = luaL_optlstring(L, 2, "", NULL);
+	uint32_t first = 0;
+	uint32_t count = 0;
+	int skip = 0;
+	int error = 0;
+	snapshot_t snapshot;
+
+	snapshot_init(&snapshot);
+	error = snapshot_map(&snapshot, filename);
+
+	switch (error)
+	{
+	case SNAPSHOT_OK:
+		break;
+
+	case SNAPSHOT_CANT_OPEN:
+		return luaL_error(L, "Import() couldn't open \"%s\"", filename);
+
+	case SNAPSHOT_BAD_VERSION:
+		return luaL_error(L, "Import() : \"%s\" has been exported by an incompatible version or on another kind of host", filename);
+
+	default:
+		return luaL_error(L, "Import() : \"%s\" is not a binary snapshot", filename);
+	}
+
+	count = snapshot_find(&snapshot, prefix, &first);
+
+	if (prefix[0] != '\0')
+	{
+		const char *dot = prefix;
+
+		for (skip = 1; (dot = strchr(dot, '.')) != NULL; ++dot)
+		{
+			++skip;
+		}
+	}
+
+	if (count == 0)
+	{
+		lua_pushnil(L);
+	}
+	else if (count == 1 && snapshot.records[first].path_length == strlen(prefix))
+	{
+		push_record(L, &snapshot, &snapshot.records[first]);
+	}
+	else
+	{
+		lua_newtable(L);
+		snapshot_walk(&snapshot, first, count, skip, &TableVisitor, L);
+	}
 
-	lua_rawset(L, -3);
+	snapshot_free(&snapshot);
+	return 1;
+}
 
-	lua_pushstring(L, "features");
+/* Adds every number, string and boolean of the table at idx (and its subtables, an empty record for empty ones)
+** to snapshot, under path */
+static void snapshot_flatten(lua_State *L, int idx, snapshot_t *snapshot, char *path, size_t length, int depth)
+{
+	int empty = TRUE;
 
-	lua_newtable(L);
+	lua_pushnil(L);
 
-	get(1);
+	while (lua_next(L, idx) != 0)
+	{
+		char index[32];
+		const char *key = NULL;
+		size_t key_length = 0;
+
+		// lua_tostring() would turn a number key into a string and confuse lua_next()
+		if (lua_type(L, -2) == LUA_TSTRING)
+		{
+			key = lua_tostring(L, -2);
+		}
+		else if (lua_type(L, -2) == LUA_TNUMBER && lua_tonumber(L, -2) >= 0 && lua_tonumber(L, -2) == (double)(uint32_t)lua_tonumber(L, -2))
+		{
+			snprintf(index, sizeof(index), "%u", (uint32_t)lua_tonumber(L, -2));
+			key = index;
+		}
+
+		if (key != NULL)
+		{
+			key_length = strlen(key);
+		}
+
+		if (key != NULL && length + key_length + 2 <= SNAPSHOT_PATH_SIZE)
+		{
+			size_t child_length = length;
+
+			if (child_length > 0)
+			{
+				path[child_length++] = '.';
+			}
+
+			memcpy(path + child_length, key, key_length + 1);
+			child_length += key_length;
+
+			switch (lua_type(L, -1))
+			{
+			case LUA_TNUMBER:
+				snapshot_number(snapshot, path, lua_tonumber(L, -1));
+				break;
+
+			case LUA_TSTRING:
+				snapshot_string(snapshot, path, lua_tostring(L, -1));
+				break;
+
+			case LUA_TBOOLEAN:
+				snapshot_boolean(snapshot, path, lua_toboolean(L, -1));
+				break;
+
+			case LUA_TTABLE:
+				if (depth + 1 < SNAPSHOT_MAX_DEPTH)
+				{
+					snapshot_flatten(L, lua_gettop(L), snapshot, path, child_length, depth + 1);
+				}
+				break;
+			}
+
+			path[length] = '\0';
+		}
+
+		empty = FALSE;
+		lua_pop(L, 1);
+	}
+
+	if (empty && depth > 0)
+	{
+		snapshot_empty(snapshot, path);
+	}
+}
+
+/* Fills snapshot from Diff() argument at idx : a table (such as SysInfo() ones), the path of a binary snapshot
+** or nothing for a live snapshot, returns a SNAPSHOT_* error */
+static int diff_argument(lua_State *L, int idx, snapshot_t *snapshot)
+{
+	char path[SNAPSHOT_PATH_SIZE];
+
+	switch (lua_type(L, idx))
+	{
+	case LUA_TNONE:
+	case LUA_TNIL:
+		snapshot_collect(snapshot, SYSINFO_ALL);
+		return SNAPSHOT_OK;
+
+	case LUA_TTABLE:
+		path[0] = '\0';
+		snapshot_flatten(L, idx, snapshot, path, 0, 0);
+		snapshot_sort(snapshot);
+		return SNAPSHOT_OK;
+
+	case LUA_TSTRING:
+		return snapshot_map(snapshot, lua_tostring(L, idx));
+
+	default:
+		return SNAPSHOT_NOT_A_FILE;
+	}
+}
+
+static int same_value(const snapshot_t *snapshot1, const snaprecord_t *record1, const snapshot_t *snapshot2, const snaprecord_t *record2)
+{
+	const char *text1 = NULL;
+	const char *text2 = NULL;
+
+	if (record1->type != record2->type)
+	{
+		return FALSE;
+	}
+
+	switch (record1->type)
+	{
+	case SNAPSHOT_NUMBER:
+		return record1->value.number == record2->value.number;
+
+	case SNAPSHOT_BOOLEAN:
+		return (record1->value.boolean != 0) == (record2->value.boolean != 0);
+
+	case SNAPSHOT_EMPTY:
+		return TRUE;
+
+	case SNAPSHOT_STRING:
+		text1 = snapshot_text(snapshot1, record1->value.string.offset, record1->value.string.length);
+		text2 = snapshot_text(snapshot2, record2->value.string.offset, record2->value.string.length);
+		return text1 != NULL && text2 != NULL && record1->value.string.length == record2->value.string.length &&
+			memcmp(text1, text2, record1->value.string.length) == 0;
+
+	default:
+		return FALSE;
+	}
+}
+
+static void push_path(lua_State *L, const snapshot_t *snapshot, const snaprecord_t *record)
+{
+	const char *path = snapshot_text(snapshot, record->path, record->path_length);
+
+	lua_pushlstring(L, (path != NULL) ? path : "", (path != NULL) ? record->path_length : 0);
+}
+
+/* Returns the differences between two snapshots (tables returned by SysInfo() or Import(), paths of files written
+** by Export(path, "binary"), or nothing for the current state of the machine) as added, removed and changed tables
+** indexed by dotted paths, computed by merging the two lists of values sorted by path */
+static SAVEDS int hw_Diff(lua_State *L)
+{
+	snapshot_t snapshots[2];
+	uint32_t i = 0;
+	uint32_t j = 0;
+	uint32_t count = 0;
+	int errors[2];
+	int k = 0;
+
+	for (k = 0; k < 2; ++k)
+	{
+		snapshot_init(&snapshots[k]);
+		errors[k] = diff_argument(L, k + 1, &snapshots[k]);
+	}
 
-	// Get the features encoded in edx
-	for(i = 0; i < EDX_FEATURES_SIZE; ++i)
+	for (k = 0; k < 2; ++k)
 	{
-		if(edx() & EdxFeatures[i].mask)
+		if (errors[k] != SNAPSHOT_OK)
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EdxFeatures[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			snapshot_free(&snapshots[0]);
+			snapshot_free(&snapshots[1]);
+
+			if (errors[k] == SNAPSHOT_BAD_VERSION)
+			{
+				return luaL_error(L, "Diff() argument %d has been exported by an incompatible version or on another kind of host", k + 1);
+			}
+
+			if (errors[k] == SNAPSHOT_CANT_OPEN)
+			{
+				return luaL_error(L, "Diff() couldn't open argument %d", k + 1);
+			}
+
+			return luaL_error(L, "Diff() argument %d must be a table or the path of a binary snapshot", k + 1);
 		}
 	}
 
-	// Get the features encoded in ecx
-	for(i = 0; i < ECX_FEATURES_SIZE; ++i)
+	// stack : result, "added", added, "removed", removed, "changed", changed
+	lua_newtable(L);
+	lua_pushstring(L, "added");
+	lua_newtable(L);
+	lua_pushstring(L, "removed");
+	lua_newtable(L);
+	lua_pushstring(L, "changed");
+	lua_newtable(L);
+
+	while (i < snapshots[0].count || j < snapshots[1].count)
 	{
-		if(ecx() & EcxFeatures[i].mask)
+		const snaprecord_t *old_record = &snapshots[0].records[i];
+		const snaprecord_t *new_record = &snapshots[1].records[j];
+		int order = 0;
+
+		if (i == snapshots[0].count)
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EcxFeatures[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			order = 1;
+		}
+		else if (j == snapshots[1].count)
+		{
+			order = -1;
+		}
+		else
+		{
+			const char *old_path = snapshot_text(&snapshots[0], old_record->path, old_record->path_length);
+			const char *new_path = snapshot_text(&snapshots[1], new_record->path, new_record->path_length);
+
+			order = snapshot_compare_paths((old_path != NULL) ? old_path : "", (old_path != NULL) ? old_record->path_length : 0,
+				(new_path != NULL) ? new_path : "", (new_path != NULL) ? new_record->path_length : 0);
+		}
+
+		if (order < 0)
+		{
+			// removed
+			push_path(L, &snapshots[0], old_record);
+			push_record(L, &snapshots[0], old_record);
+			lua_rawset(L, -5);
+			++i;
+			++count;
+		}
+		else if (order > 0)
+		{
+			// added
+			push_path(L, &snapshots[1], new_record);
+			push_record(L, &snapshots[1], new_record);
+			lua_rawset(L, -7);
+			++j;
+			++count;
+		}
+		else
+		{
+			if (!same_value(&snapshots[0], old_record, &snapshots[1], new_record))
+			{
+				push_path(L, &snapshots[1], new_record);
+				lua_newtable(L);
+
+				lua_pushstring(L, "old");
+				push_record(L, &snapshots[0], old_record);
+				lua_rawset(L, -3);
+
+				lua_pushstring(L, "new");
+				push_record(L, &snapshots[1], new_record);
+				lua_rawset(L, -3);
+
+				lua_rawset(L, -3);
+				++count;
+			}
+
+			++i;
+			++j;
 		}
 	}
 
+	snapshot_free(&snapshots[0]);
+	snapshot_free(&snapshots[1]);
+
+	lua_rawset(L, -7);
+	lua_rawset(L, -5);
 	lua_rawset(L, -3);
 
-	lua_pushstring(L, "extended_features");
+	set_number(L, "count", count);
 
-	lua_newtable(L);
+	return 1;
+}
+
+#define FINGERPRINT_CPU        0
+#define FINGERPRINT_FEATURES   1
+#define FINGERPRINT_BOARD      2
+#define FINGERPRINT_BIOS       3
+#define FINGERPRINT_SERIALS    4
+#define FINGERPRINT_COMPONENTS 5
+
+static const char *FingerprintComponents[FINGERPRINT_COMPONENTS] = { "cpu", "features", "board", "bios", "serials" };
+
+// sys table values describing the installation rather than the hardware, or repeating other values (any group if NULL)
+static const struct
+{
+	const char *group;
+	const char *key;
+
+} FingerprintSkippedKeys[] =
+{
+	{ NULL,          "modalias" },      // repeats all other DMI values
+	{ NULL,          "uevent" },
+	{ NULL,          "Status" },        // "OK", "Degraded"... under Windows
+	// host name under Windows (Win32_MotherboardDevice and Win32_ComputerSystem)
+	{ "Motherboard", "SystemName" },
+	{ "Computer",    "Name" },
+	{ "Computer",    "Caption" },
+	{ NULL,          NULL }
+};
+
+/* Raw feature registers hashed into the features digest */
+typedef struct
+{
+	uint32_t leaf;
+	uint32_t subleaf;
+	int reg;
+	const char *name;
+
+} fingerprint_register_t;
+
+static const fingerprint_register_t FingerprintRegisters[] =
+{
+	{ 0x00000001, 0, CPUID_ECX, "1.ecx" },
+	{ 0x00000001, 0, CPUID_EDX, "1.edx" },
+	{ 0x00000007, 0, CPUID_EBX, "7.ebx" },
+	{ 0x00000007, 0, CPUID_ECX, "7.ecx" },
+	{ 0x00000007, 0, CPUID_EDX, "7.edx" },
+	{ 0x00000007, 1, CPUID_EAX, "7.1.eax" },
+	{ 0x80000001, 0, CPUID_ECX, "80000001.ecx" },
+	{ 0x80000001, 0, CPUID_EDX, "80000001.edx" },
+	{ 0, 0, 0, NULL }
+};
+
+// features reflecting what the OS has enabled rather than what the processor has
+static const int FingerprintOsFeatures[] = { FEATURE_OSXSAVE, FEATURE_OSPKE, -1 };
+
+typedef struct
+{
+	uint32_t digests[FINGERPRINT_COMPONENTS];
+	uint32_t combined;
+
+} fingerprint_t;
+
+static void fingerprint_feed(fingerprint_t *fingerprint, int component, const char *data, size_t size)
+{
+	fingerprint->digests[component] = crc32c(fingerprint->digests[component], data, size);
+	fingerprint->combined = crc32c(fingerprint->combined, data, size);
+}
+
+/* Hashes "component.key=value\n" (value without surrounding blanks) into the component and combined digests */
+static void fingerprint_add(fingerprint_t *fingerprint, int component, const char *key, const char *value, size_t length)
+{
+	const char *name = FingerprintComponents[component];
+
+	while (length > 0 && isspace((unsigned char)value[0]))
+	{
+		++value;
+		--length;
+	}
+
+	while (length > 0 && (isspace((unsigned char)value[length - 1]) || value[length - 1] == '\0'))
+	{
+		--length;
+	}
+
+	fingerprint_feed(fingerprint, component, name, strlen(name));
+	fingerprint_feed(fingerprint, component, ".", 1);
+	fingerprint_feed(fingerprint, component, key, strlen(key));
+	fingerprint_feed(fingerprint, component, "=", 1);
+	fingerprint_feed(fingerprint, component, value, length);
+	fingerprint_feed(fingerprint, component, "\n", 1);
+}
+
+static void fingerprint_hex(fingerprint_t *fingerprint, int component, const char *key, uint32_t value)
+{
+	char hex[16];
+
+	snprintf(hex, sizeof(hex), "%08x", value);
+	fingerprint_add(fingerprint, component, key, hex, strlen(hex));
+}
+
+/* Vendor, signature (family, model, stepping) and brand string, straight from CPUID */
+static void fingerprint_cpu(fingerprint_t *fingerprint, const cpuid_snapshot_t *snap)
+{
+	const uint32_t *leaf0 = cpuid_leaf(snap, 0, 0);
+	const uint32_t *leaf1 = cpuid_leaf(snap, 1, 0);
+	uint32_t brand[12];
+	uint32_t idx = 0;
+	char vendor_string[12];
 
-	get(7);
+	if (leaf0 != NULL)
+	{
+		memcpy(&vendor_string[0], &leaf0[CPUID_EBX], 4);
+		memcpy(&vendor_string[4], &leaf0[CPUID_EDX], 4);
+		memcpy(&vendor_string[8], &leaf0[CPUID_ECX], 4);
+		fingerprint_add(fingerprint, FINGERPRINT_CPU, "vendor", vendor_string, sizeof(vendor_string));
+	}
 
-	array_index = 0;
+	if (leaf1 != NULL)
+	{
+		// without reserved bits
+		fingerprint_hex(fingerprint, FINGERPRINT_CPU, "signature", leaf1[CPUID_EAX] & 0x0FFF3FFF);
+	}
 
-	// Get the extended features encoded in ebx
-	for(i = 0; i < EBX_EXT_FEATURES_SIZE; ++i)
+	for (idx = 0; idx < 3; ++idx)
 	{
-		if(ebx() & EbxExtFeatures[i].mask)
+		const uint32_t *leaf = cpuid_leaf(snap, 0x80000002 + idx, 0);
+
+		if (leaf == NULL)
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EbxExtFeatures[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			return;
 		}
+
+		memcpy(&brand[4 * idx], leaf, 4 * sizeof(uint32_t));
 	}
 
-	// Get the extended features encoded in ecx
-	for(i = 0; i < ECX_EXT_FEATURES_SIZE; ++i)
+	fingerprint_add(fingerprint, FINGERPRINT_CPU, "brand", (const char *)brand, sizeof(brand));
+}
+
+static void fingerprint_features(fingerprint_t *fingerprint, const cpuid_snapshot_t *snap)
+{
+	const fingerprint_register_t *reg = NULL;
+
+	for (reg = FingerprintRegisters; reg->name != NULL; ++reg)
 	{
-		if(ecx() & EcxExtFeatures[i].mask)
+		const uint32_t *leaf = cpuid_leaf(snap, reg->leaf, reg->subleaf);
+		uint32_t ignored = 0;
+		int i = 0;
+
+		for (i = 0; FingerprintOsFeatures[i] >= 0; ++i)
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EcxExtFeatures[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			const feature_t *feature = &Features[FingerprintOsFeatures[i]];
+
+			if (feature->leaf == reg->leaf && feature->subleaf == reg->subleaf && feature->reg == reg->reg)
+			{
+				ignored |= 1u << feature->bit;
+			}
 		}
+
+		fingerprint_hex(fingerprint, FINGERPRINT_FEATURES, reg->name, (leaf != NULL) ? leaf[reg->reg] & ~ignored : 0);
 	}
+}
 
-	get(0x80000001);
+static int lowercase_contains(const char *text, const char *word)
+{
+	size_t length = strlen(word);
 
-	// Get the extended functions encoded in ecx
-	for(i = 0; i < ECX_EXT_FUNCTIONS_SIZE; ++i)
+	for (; *text != '\0'; ++text)
 	{
-		if(ecx() & EcxExtFunctions[i].mask)
+		size_t i = 0;
+
+		while (i < length && tolower((unsigned char)text[i]) == word[i])
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EcxExtFunctions[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			++i;
+		}
+
+		if (i == length)
+		{
+			return TRUE;
 		}
 	}
 
-	// Get the extended functions encoded in edx
-	for(i = 0; i < EDX_EXT_FUNCTIONS_SIZE; ++i)
+	return FALSE;
+}
+
+/* Component a sys table value belongs to, -1 if it doesn't identify the hardware */
+static int fingerprint_component(const sysentry_t *entry)
+{
+	int i = 0;
+
+	for (i = 0; FingerprintSkippedKeys[i].key != NULL; ++i)
 	{
-		if(edx() & EdxExtFunctions[i].mask)
+		if (strcmp(entry->key, FingerprintSkippedKeys[i].key) == 0 &&
+			(FingerprintSkippedKeys[i].group == NULL || same_group(entry->group, FingerprintSkippedKeys[i].group)))
 		{
-			lua_pushnumber(L, array_index);
-			lua_pushstring(L, EdxExtFunctions[i].name);
-			lua_rawset(L, -3);
-			++array_index;
+			return -1;
 		}
 	}
 
-	lua_rawset(L, -3);
+	// asset tags are set by the owner to tell this very machine apart, as serials do
+	if (lowercase_contains(entry->key, "serial") || lowercase_contains(entry->key, "uuid") || lowercase_contains(entry->key, "asset_tag"))
+	{
+		return FINGERPRINT_SERIALS;
+	}
 
-	lua_pushstring(L, "caches");
-	lua_newtable(L);
+	if ((entry->group != NULL && strcmp(entry->group, "BIOS") == 0) || strncmp(entry->key, "bios_", 5) == 0)
+	{
+		return FINGERPRINT_BIOS;
+	}
 
-	I(cache_line_size)
-	I(cache_size)
-	I(processor_cache_line_size)
+	return FINGERPRINT_BOARD;
+}
 
-	get(2);
+/* Orders sys table values by group (values without group first) then key, whatever the OS enumeration order */
+static int compare_sysentries(const void *entry1, const void *entry2)
+{
+	const sysentry_t *e1 = *(const sysentry_t * const *)entry1;
+	const sysentry_t *e2 = *(const sysentry_t * const *)entry2;
 
-	if (valid)
+	if (!same_group(e1->group, e2->group))
 	{
-		array_index = 0;
-
-		if(~eax() & 0x80000000)
+		if (e1->group == NULL || e2->group == NULL)
 		{
-			add_cache_tlb_info(L, eax() >> 8, &array_index);
+			return (e1->group == NULL) ? -1 : 1;
 		}
-		if(~ebx() & 0x80000000)
+
+		return strcmp(e1->group, e2->group);
+	}
+
+	return strcmp(e1->key, e2->key);
+}
+
+static void fingerprint_sys(fingerprint_t *fingerprint, int serials)
+{
+	const systable_t *table = get_systable();
+	const sysentry_t **entries = malloc((table->count + 1) * sizeof(sysentry_t *));
+	int i = 0;
+
+	if (entries == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < table->count; ++i)
+	{
+		entries[i] = &table->entries[i];
+	}
+
+	qsort(entries, table->count, sizeof(sysentry_t *), compare_sysentries);
+
+	for (i = 0; i < table->count; ++i)
+	{
+		const sysentry_t *entry = entries[i];
+		int component = fingerprint_component(entry);
+		char key[SNAPSHOT_PATH_SIZE];
+
+		if (component < 0 || (component == FINGERPRINT_SERIALS && !serials))
 		{
-			add_cache_tlb_info(L, ebx(), &array_index);
+			continue;
 		}
-		if(~ecx() & 0x80000000)
+
+		if (entry->group != NULL)
 		{
-			add_cache_tlb_info(L, ecx(), &array_index);
+			snprintf(key, sizeof(key), "%s.%s", entry->group, entry->key);
 		}
-		if(~edx() & 0x80000000)
+		else
 		{
-			add_cache_tlb_info(L, edx(), &array_index);
+			snprintf(key, sizeof(key), "%s", entry->key);
 		}
+
+		fingerprint_add(fingerprint, component, key, entry->value, strlen(entry->value));
 	}
 
+	free(entries);
+}
+
+static void set_digest(lua_State *L, const char *key, uint32_t digest)
+{
+	char hex[16];
+
+	snprintf(hex, sizeof(hex), "%08x", digest);
+
+	lua_pushstring(L, key);
+	lua_pushstring(L, hex);
 	lua_rawset(L, -3);
+}
 
-	get(0x16);
+/* Returns CRC32C digests (as 8 hex digits) of the processor identity, its features, the board and BIOS values
+** of the sys table (and their serial numbers if serials is True), plus a combined digest of all of them */
+static SAVEDS int hw_Fingerprint(lua_State *L)
+{
+	const cpuid_snapshot_t *snap = cpuid_snapshot();
+	int serials = luaL_optnumber(L, 1, 0) != 0;
+	fingerprint_t fingerprint;
+	int i = 0;
 
-	if (valid)
+	memset(&fingerprint, 0, sizeof(fingerprint));
+
+	fingerprint_cpu(&fingerprint, snap);
+	fingerprint_features(&fingerprint, snap);
+	fingerprint_sys(&fingerprint, serials);
+
+	lua_newtable(L);
+
+	for (i = 0; i < FINGERPRINT_COMPONENTS; ++i)
 	{
-		lua_pushstring(L, "freqs");
-		lua_newtable(L);
-		I(processor_base_frequency_MHz)
-		I(processor_max_frequency_MHz)
-		I(processor_bus_reference_frequency_MHz)
-		lua_rawset(L, -3);
+		if (i != FINGERPRINT_SERIALS || serials)
+		{
+			set_digest(L, FingerprintComponents[i], fingerprint.digests[i]);
+		}
 	}
 
-	lua_rawset(L, -3);
+	set_digest(L, "combined", fingerprint.combined);
+	set_boolean(L, "accelerated", crc32c_accelerated());
+
+	return 1;
+}
 
-	lua_pushstring(L, "sys");
+/* Returns a table containing internal counters of the plugin (mostly for diagnostic purpose) */
+static SAVEDS int hw_Stats(lua_State *L)
+{
 	lua_newtable(L);
 
-	fill_systable((void *)L);
+	lua_pushstring(L, "cpuid_passes");
+	lua_pushnumber(L, cpuid_passes);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "cpuid_instructions");
+	lua_pushnumber(L, cpuid_instructions);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "cpuid_core_passes");
+	lua_pushnumber(L, cpuid_core_passes);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "cpuid_core_instructions");
+	lua_pushnumber(L, cpuid_core_instructions);
+	lua_rawset(L, -3);
+
+	// age (in seconds) of cached data, -1 when nothing is cached yet
+	lua_pushstring(L, "cpuid_age");
+	lua_pushnumber(L, snapshot_taken ? monotonic_seconds() - snapshot_time : -1);
+	lua_rawset(L, -3);
+
+	lua_pushstring(L, "sys_age");
+	lua_pushnumber(L, systable_valid ? monotonic_seconds() - systable_time : -1);
+	lua_rawset(L, -3);
 
+	lua_pushstring(L, "sys_collections");
+	lua_pushnumber(L, systable_collections);
 	lua_rawset(L, -3);
 
 	return 1;
+}
+
+/* Drops every cached information so that it gets collected again on next use */
+static SAVEDS int hw_Refresh(lua_State *L)
+{
+	snapshot_taken = FALSE;
+	systable_valid = FALSE;
+	// decoded again from the new snapshot
+	features_decoded = FALSE;
 
+	return 0;
 }
 
 /* table containing all commands to be added by this plugin */
 struct hwCmdStruct plug_commands[] = {
 	{(STRPTR)"SysInfo", hw_SysInfo},
+	{(STRPTR)"Stats", hw_Stats},
+	{(STRPTR)"Refresh", hw_Refresh},
+	{(STRPTR)"Topology", hw_Topology},
+	{(STRPTR)"CPULoad", hw_CPULoad},
+	{(STRPTR)"MemInfo", hw_MemInfo},
+	{(STRPTR)"CPUFreq", hw_CPUFreq},
+	{(STRPTR)"Ticks", hw_Ticks},
+	{(STRPTR)"TicksToNs", hw_TicksToNs},
+	{(STRPTR)"TimerInfo", hw_TimerInfo},
+	{(STRPTR)"BenchMemory", hw_BenchMemory},
+	{(STRPTR)"BenchLatency", hw_BenchLatency},
+	{(STRPTR)"HasFeature", hw_HasFeature},
+	{(STRPTR)"HasFeatures", hw_HasFeatures},
+	{(STRPTR)"PerfBegin", hw_PerfBegin},
+	{(STRPTR)"PerfEnd", hw_PerfEnd},
+	{(STRPTR)"PerfReport", hw_PerfReport},
+	{(STRPTR)"ProcessInfo", hw_ProcessInfo},
+	{(STRPTR)"StartMonitor", hw_StartMonitor},
+	{(STRPTR)"GetLatest", hw_GetLatest},
+	{(STRPTR)"StopMonitor", hw_StopMonitor},
+	{(STRPTR)"GetHistory", hw_GetHistory},
+	{(STRPTR)"Export", hw_Export},
+	{(STRPTR)"Import", hw_Import},
+	{(STRPTR)"Fingerprint", hw_Fingerprint},
+	{(STRPTR)"Diff", hw_Diff},
+	{(STRPTR)"GetCurrentCPU", hw_GetCurrentCPU},
+	{(STRPTR)"GetAffinity", hw_GetAffinity},
+	{(STRPTR)"SetAffinity", hw_SetAffinity},
+	{(STRPTR)"RecommendCPUs", hw_RecommendCPUs},
+	{(STRPTR)"CoreTypes", hw_CoreTypes},
+	{(STRPTR)"Disks", hw_Disks},
+	{(STRPTR)"DiskStats", hw_DiskStats},
 	{NULL, NULL}
 };
 
@@ -1009,4 +4319,27 @@ HW_EXPORT void _FreeLibrary(lua_State *L)
 HW_EXPORT void FreeLibrary(lua_State *L)
 #endif
 {
+	// stopped first : the sampler thread uses the OS specific part released below
+	monitor_stop();
+
+	free_systable(&systable);
+	systable_valid = FALSE;
+
+	cpu_load_free(&cpu_load_state);
+	free(cpu_loads);
+	cpu_loads = NULL;
+	cpu_loads_capacity = 0;
+
+	free(cpu_freqs);
+	cpu_freqs = NULL;
+	cpu_freqs_capacity = 0;
+
+	free(disk_stats_state.counters);
+	free(disk_counters);
+	memset(&disk_stats_state, 0, sizeof(disk_stats_state));
+	disk_counters = NULL;
+
+	perf_free();
+
+	os_release();
 }
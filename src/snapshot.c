@@ -0,0 +1,719 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// records are written as is : their layout must not depend on the compiler
+typedef char snaprecord_size_check[(sizeof(snaprecord_t) == 16) ? 1 : -1];
+typedef char snapheader_size_check[(sizeof(snapheader_t) == 32) ? 1 : -1];
+
+// stdio buffer of the writers
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+void snapshot_init(snapshot_t *snapshot)
+{
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+void snapshot_free(snapshot_t *snapshot)
+{
+	if (snapshot->mapping != NULL)
+	{
+		os_unmap_file(snapshot->mapping, snapshot->mapping_size);
+	}
+	else
+	{
+		free(snapshot->records);
+		free(snapshot->strings);
+	}
+
+	snapshot_init(snapshot);
+}
+
+/* Appends text and a NUL to strings, returns its offset (or -1 if out of memory) */
+static long add_text(snapshot_t *snapshot, const char *text, uint32_t length)
+{
+	uint32_t offset = snapshot->strings_size;
+
+	if (snapshot->strings_size + length + 1 > snapshot->strings_capacity)
+	{
+		uint32_t capacity = snapshot->strings_capacity ? snapshot->strings_capacity : 4096;
+		char *strings = NULL;
+
+		while (snapshot->strings_size + length + 1 > capacity)
+		{
+			capacity *= 2;
+		}
+
+		strings = realloc(snapshot->strings, capacity);
+
+		if (strings == NULL)
+		{
+			return -1;
+		}
+
+		snapshot->strings = strings;
+		snapshot->strings_capacity = capacity;
+	}
+
+	memcpy(snapshot->strings + offset, text, length);
+	snapshot->strings[offset + length] = '\0';
+	snapshot->strings_size += length + 1;
+
+	return (long)offset;
+}
+
+static snaprecord_t *add_record(snapshot_t *snapshot, const char *path, int type)
+{
+	size_t length = strlen(path);
+	snaprecord_t *record = NULL;
+	long offset = 0;
+
+	// a mapped snapshot is read only
+	if (snapshot->mapping != NULL || length > 0xFFFF)
+	{
+		return NULL;
+	}
+
+	if (snapshot->count == snapshot->capacity)
+	{
+		uint32_t capacity = snapshot->capacity ? 2 * snapshot->capacity : 256;
+		snaprecord_t *records = realloc(snapshot->records, capacity * sizeof(snaprecord_t));
+
+		if (records == NULL)
+		{
+			return NULL;
+		}
+
+		snapshot->records = records;
+		snapshot->capacity = capacity;
+	}
+
+	offset = add_text(snapshot, path, (uint32_t)length);
+
+	if (offset < 0)
+	{
+		return NULL;
+	}
+
+	record = &snapshot->records[snapshot->count++];
+	memset(record, 0, sizeof(*record));
+	record->path = (uint32_t)offset;
+	record->path_length = (uint16_t)length;
+	record->type = (uint8_t)type;
+
+	return record;
+}
+
+int snapshot_number(snapshot_t *snapshot, const char *path, double value)
+{
+	snaprecord_t *record = add_record(snapshot, path, SNAPSHOT_NUMBER);
+
+	if (record == NULL)
+	{
+		return FALSE;
+	}
+
+	record->value.number = value;
+	return TRUE;
+}
+
+int snapshot_string(snapshot_t *snapshot, const char *path, const char *value)
+{
+	size_t length = strlen(value);
+	snaprecord_t *record = add_record(snapshot, path, SNAPSHOT_STRING);
+	long offset = 0;
+
+	if (record == NULL)
+	{
+		return FALSE;
+	}
+
+	offset = add_text(snapshot, value, (uint32_t)length);
+
+	if (offset < 0)
+	{
+		--snapshot->count;
+		return FALSE;
+	}
+
+	// add_text() may have moved strings, but not records
+	record->value.string.offset = (uint32_t)offset;
+	record->value.string.length = (uint32_t)length;
+	return TRUE;
+}
+
+int snapshot_boolean(snapshot_t *snapshot, const char *path, int value)
+{
+	snaprecord_t *record = add_record(snapshot, path, SNAPSHOT_BOOLEAN);
+
+	if (record == NULL)
+	{
+		return FALSE;
+	}
+
+	record->value.boolean = (value != 0);
+	return TRUE;
+}
+
+int snapshot_empty(snapshot_t *snapshot, const char *path)
+{
+	return add_record(snapshot, path, SNAPSHOT_EMPTY) != NULL;
+}
+
+/* Text of given range of strings, NULL if it lies outside (which only happens with a damaged file) */
+const char *snapshot_text(const snapshot_t *snapshot, uint32_t offset, uint32_t length)
+{
+	if ((uint64_t)offset + length > snapshot->strings_size)
+	{
+		return NULL;
+	}
+
+	return snapshot->strings + offset;
+}
+
+static const char *record_path(const snapshot_t *snapshot, const snaprecord_t *record, uint32_t *length)
+{
+	const char *path = snapshot_text(snapshot, record->path, record->path_length);
+
+	*length = (path != NULL) ? record->path_length : 0;
+	return (path != NULL) ? path : "";
+}
+
+int snapshot_numeric(const char *segment, uint32_t length)
+{
+	uint32_t i = 0;
+
+	if (length == 0 || length > 9)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < length; ++i)
+	{
+		if (segment[i] < '0' || segment[i] > '9')
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static uint32_t segment_length(const char *path, uint32_t length)
+{
+	const char *dot = memchr(path, '.', length);
+
+	return (dot != NULL) ? (uint32_t)(dot - path) : length;
+}
+
+/* Array indices are sorted by value and before names, names are sorted by bytes */
+static int compare_segments(const char *segment1, uint32_t length1, const char *segment2, uint32_t length2)
+{
+	int numeric1 = snapshot_numeric(segment1, length1);
+	int numeric2 = snapshot_numeric(segment2, length2);
+	int result = 0;
+
+	if (numeric1 != numeric2)
+	{
+		return numeric1 ? -1 : 1;
+	}
+
+	if (numeric1 && length1 != length2)
+	{
+		return (length1 < length2) ? -1 : 1;
+	}
+
+	result = memcmp(segment1, segment2, (length1 < length2) ? length1 : length2);
+
+	if (result != 0 || length1 == length2)
+	{
+		return result;
+	}
+
+	return (length1 < length2) ? -1 : 1;
+}
+
+/* Orders paths segment by segment, so that each subtree is a contiguous range of sorted records */
+int snapshot_compare_paths(const char *path1, uint32_t length1, const char *path2, uint32_t length2)
+{
+	for (;;)
+	{
+		uint32_t segment1 = segment_length(path1, length1);
+		uint32_t segment2 = segment_length(path2, length2);
+		int result = compare_segments(path1, segment1, path2, segment2);
+
+		if (result != 0)
+		{
+			return result;
+		}
+
+		// same segment : the path having no more segments comes first
+		if (segment1 == length1 && segment2 == length2)
+		{
+			return 0;
+		}
+
+		if (segment1 == length1 || segment2 == length2)
+		{
+			return (segment1 == length1) ? -1 : 1;
+		}
+
+		path1 += segment1 + 1;
+		length1 -= segment1 + 1;
+		path2 += segment2 + 1;
+		length2 -= segment2 + 1;
+	}
+}
+
+// qsort() has no context argument, snapshots are only sorted from the script thread
+static const snapshot_t *sorted_snapshot;
+
+static int compare_records(const void *record1, const void *record2)
+{
+	uint32_t length1 = 0;
+	uint32_t length2 = 0;
+	const char *path1 = record_path(sorted_snapshot, (const snaprecord_t *)record1, &length1);
+	const char *path2 = record_path(sorted_snapshot, (const snaprecord_t *)record2, &length2);
+
+	return snapshot_compare_paths(path1, length1, path2, length2);
+}
+
+void snapshot_sort(snapshot_t *snapshot)
+{
+	if (snapshot->mapping == NULL && snapshot->count > 1)
+	{
+		sorted_snapshot = snapshot;
+		qsort(snapshot->records, snapshot->count, sizeof(snaprecord_t), compare_records);
+		sorted_snapshot = NULL;
+	}
+}
+
+static int has_prefix(const char *path, uint32_t length, const char *prefix, uint32_t prefix_length)
+{
+	return length >= prefix_length && memcmp(path, prefix, prefix_length) == 0 &&
+		(length == prefix_length || path[prefix_length] == '.');
+}
+
+/* Finds the records of the value or subtree at prefix (all records if prefix is NULL or empty) with a binary search,
+** returns their count */
+uint32_t snapshot_find(const snapshot_t *snapshot, const char *prefix, uint32_t *first)
+{
+	uint32_t prefix_length = (prefix != NULL) ? (uint32_t)strlen(prefix) : 0;
+	uint32_t low = 0;
+	uint32_t high = snapshot->count;
+	uint32_t end = 0;
+
+	if (prefix_length == 0)
+	{
+		*first = 0;
+		return snapshot->count;
+	}
+
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		uint32_t length = 0;
+		const char *path = record_path(snapshot, &snapshot->records[middle], &length);
+
+		if (snapshot_compare_paths(path, length, prefix, prefix_length) < 0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	for (end = low; end < snapshot->count; ++end)
+	{
+		uint32_t length = 0;
+		const char *path = record_path(snapshot, &snapshot->records[end], &length);
+
+		if (!has_prefix(path, length, prefix, prefix_length))
+		{
+			break;
+		}
+	}
+
+	*first = low;
+	return end - low;
+}
+
+/* A container is an array when all its children are array indices, that is when its last child is one */
+static int is_array(const snapshot_t *snapshot, uint32_t first, uint32_t end, uint32_t container_length)
+{
+	uint32_t length = 0;
+	const char *container = record_path(snapshot, &snapshot->records[first], &length);
+	const char *path = container;
+	uint32_t last = first;
+
+	while (last + 1 < end)
+	{
+		path = record_path(snapshot, &snapshot->records[last + 1], &length);
+
+		if (!has_prefix(path, length, container, container_length) || length == container_length)
+		{
+			break;
+		}
+
+		++last;
+	}
+
+	path = record_path(snapshot, &snapshot->records[last], &length);
+	path += container_length + 1;
+	length -= container_length + 1;
+
+	return snapshot_numeric(path, segment_length(path, length));
+}
+
+/* Calls visitor for count sorted records from first, as a tree of containers (the first skip segments of
+** each path are ignored), returns FALSE if some records have been left out because they were too deep */
+int snapshot_walk(const snapshot_t *snapshot, uint32_t first, uint32_t count, int skip, const snapshot_visitor_t *visitor, void *context)
+{
+	const char *opened[SNAPSHOT_MAX_DEPTH];
+	uint32_t opened_lengths[SNAPSHOT_MAX_DEPTH];
+	int arrays[SNAPSHOT_MAX_DEPTH];
+	int depth = 0;
+	int complete = TRUE;
+	uint32_t end = first + count;
+	uint32_t i = 0;
+
+	for (i = first; i < end; ++i)
+	{
+		const char *segments[SNAPSHOT_MAX_DEPTH + 1];
+		uint32_t lengths[SNAPSHOT_MAX_DEPTH + 1];
+		uint32_t length = 0;
+		const char *path = record_path(snapshot, &snapshot->records[i], &length);
+		const char *cursor = path;
+		uint32_t left = length;
+		int segment_count = 0;
+		int common = 0;
+		int k = 0;
+
+		while (segment_count <= SNAPSHOT_MAX_DEPTH)
+		{
+			uint32_t segment = segment_length(cursor, left);
+
+			segments[segment_count] = cursor;
+			lengths[segment_count] = segment;
+			++segment_count;
+
+			if (segment == left)
+			{
+				break;
+			}
+
+			cursor += segment + 1;
+			left -= segment + 1;
+		}
+
+		if (segment_count > SNAPSHOT_MAX_DEPTH || segment_count <= skip)
+		{
+			complete = complete && segment_count <= skip;
+			continue;
+		}
+
+		// containers already opened for previous record
+		while (common < depth && common + skip + 1 < segment_count &&
+			opened_lengths[common] == lengths[common + skip] && memcmp(opened[common], segments[common + skip], opened_lengths[common]) == 0)
+		{
+			++common;
+		}
+
+		while (depth > common)
+		{
+			--depth;
+			visitor->close(context, arrays[depth]);
+		}
+
+		for (k = skip + depth; k < segment_count - 1; ++k)
+		{
+			uint32_t container_length = (uint32_t)(segments[k] + lengths[k] - path);
+
+			arrays[depth] = is_array(snapshot, i, end, container_length);
+			opened[depth] = segments[k];
+			opened_lengths[depth] = lengths[k];
+			visitor->open(context, segments[k], lengths[k], arrays[depth]);
+			++depth;
+		}
+
+		visitor->value(context, segments[segment_count - 1], lengths[segment_count - 1], snapshot, &snapshot->records[i]);
+	}
+
+	while (depth > 0)
+	{
+		--depth;
+		visitor->close(context, arrays[depth]);
+	}
+
+	return complete;
+}
+
+typedef struct
+{
+	FILE *file;
+	int depth;
+	int arrays[SNAPSHOT_MAX_DEPTH + 1];     // arrays[0] is the root object
+	int items[SNAPSHOT_MAX_DEPTH + 1];      // values already written in each container
+
+} json_writer_t;
+
+static void json_string(FILE *file, const char *text, uint32_t length)
+{
+	uint32_t i = 0;
+
+	fputc('"', file);
+
+	for (i = 0; i < length; ++i)
+	{
+		unsigned char c = (unsigned char)text[i];
+
+		if (c == '"' || c == '\\')
+		{
+			fputc('\\', file);
+			fputc(c, file);
+		}
+		else if (c < 0x20)
+		{
+			fprintf(file, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, file);
+		}
+	}
+
+	fputc('"', file);
+}
+
+/* Separator and key (if in an object) of next item of current container */
+static void json_item(json_writer_t *writer, const char *key, uint32_t length)
+{
+	if (writer->items[writer->depth]++ > 0)
+	{
+		fputc(',', writer->file);
+	}
+
+	if (!writer->arrays[writer->depth])
+	{
+		json_string(writer->file, key, length);
+		fputc(':', writer->file);
+	}
+}
+
+static void json_open(void *context, const char *key, uint32_t length, int array)
+{
+	json_writer_t *writer = (json_writer_t *)context;
+
+	json_item(writer, key, length);
+	fputc(array ? '[' : '{', writer->file);
+
+	++writer->depth;
+	writer->arrays[writer->depth] = array;
+	writer->items[writer->depth] = 0;
+}
+
+static void json_close(void *context, int array)
+{
+	json_writer_t *writer = (json_writer_t *)context;
+
+	fputc(array ? ']' : '}', writer->file);
+	--writer->depth;
+}
+
+static void json_value(void *context, const char *key, uint32_t length, const snapshot_t *snapshot, const snaprecord_t *record)
+{
+	json_writer_t *writer = (json_writer_t *)context;
+	double number = record->value.number;
+	const char *text = NULL;
+
+	json_item(writer, key, length);
+
+	switch (record->type)
+	{
+	case SNAPSHOT_NUMBER:
+		if (number != number || number - number != 0.0)
+		{
+			// NaN and infinities have no JSON representation
+			fputs("null", writer->file);
+		}
+		else if (floor(number) == number && fabs(number) < 1e15)
+		{
+			fprintf(writer->file, "%.0f", number);
+		}
+		else
+		{
+			fprintf(writer->file, "%.17g", number);
+		}
+		break;
+
+	case SNAPSHOT_STRING:
+		text = snapshot_text(snapshot, record->value.string.offset, record->value.string.length);
+		json_string(writer->file, (text != NULL) ? text : "", (text != NULL) ? record->value.string.length : 0);
+		break;
+
+	case SNAPSHOT_BOOLEAN:
+		fputs(record->value.boolean ? "true" : "false", writer->file);
+		break;
+
+	case SNAPSHOT_EMPTY:
+		// Lua can't tell an empty array from an empty object, and all SysInfo() ones are arrays
+		fputs("[]", writer->file);
+		break;
+
+	default:
+		fputs("null", writer->file);
+		break;
+	}
+}
+
+/* Writes a sorted snapshot as a JSON object, streaming it record after record */
+int snapshot_write_json(const snapshot_t *snapshot, const char *filename)
+{
+	static const snapshot_visitor_t JsonVisitor = { json_open, json_close, json_value };
+	json_writer_t writer;
+	int result = FALSE;
+
+	memset(&writer, 0, sizeof(writer));
+	writer.file = fopen(filename, "wb");
+
+	if (writer.file == NULL)
+	{
+		return FALSE;
+	}
+
+	setvbuf(writer.file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+	fputc('{', writer.file);
+	snapshot_walk(snapshot, 0, snapshot->count, 0, &JsonVisitor, &writer);
+	fputs("}\n", writer.file);
+
+	result = !ferror(writer.file);
+	result = (fclose(writer.file) == 0) && result;
+
+	if (!result)
+	{
+		remove(filename);
+	}
+
+	return result;
+}
+
+/* Writes a sorted snapshot as header, records then strings, so that snapshot_map() can use it in place */
+int snapshot_write_binary(const snapshot_t *snapshot, const char *filename)
+{
+	snapheader_t header;
+	FILE *file = NULL;
+	int result = FALSE;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.header_size = sizeof(snapheader_t);
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.count = snapshot->count;
+	header.record_size = sizeof(snaprecord_t);
+	header.records_offset = sizeof(snapheader_t);
+	header.strings_offset = header.records_offset + snapshot->count * sizeof(snaprecord_t);
+	header.strings_size = snapshot->strings_size;
+
+	file = fopen(filename, "wb");
+
+	if (file == NULL)
+	{
+		return FALSE;
+	}
+
+	setvbuf(file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+	result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(snapshot->records, sizeof(snaprecord_t), snapshot->count, file) == snapshot->count &&
+		fwrite(snapshot->strings, 1, snapshot->strings_size, file) == snapshot->strings_size;
+
+	result = (fclose(file) == 0) && result;
+
+	if (!result)
+	{
+		remove(filename);
+	}
+
+	return result;
+}
+
+/* Maps a binary snapshot file : only its header is checked, records and strings are used in place */
+int snapshot_map(snapshot_t *snapshot, const char *filename)
+{
+	const snapheader_t *header = NULL;
+	size_t size = 0;
+	const char *data = os_map_file(filename, &size);
+	int result = SNAPSHOT_NOT_A_FILE;
+
+	if (data == NULL)
+	{
+		return SNAPSHOT_CANT_OPEN;
+	}
+
+	header = (const snapheader_t *)data;
+
+	if (size < sizeof(snapheader_t) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+	{
+		result = SNAPSHOT_NOT_A_FILE;
+	}
+	else if (header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER)
+	{
+		result = SNAPSHOT_BAD_VERSION;
+	}
+	else if (header->header_size < sizeof(snapheader_t) || header->record_size != sizeof(snaprecord_t) ||
+		header->records_offset < header->header_size || header->records_offset % sizeof(double) != 0 ||
+		(uint64_t)header->records_offset + (uint64_t)header->count * sizeof(snaprecord_t) > size ||
+		(uint64_t)header->strings_offset + header->strings_size > size)
+	{
+		result = SNAPSHOT_NOT_A_FILE;
+	}
+	else
+	{
+		snapshot_free(snapshot);
+		snapshot->records = (snaprecord_t *)(data + header->records_offset);
+		snapshot->count = header->count;
+		snapshot->capacity = header->count;
+		snapshot->strings = (char *)(data + header->strings_offset);
+		snapshot->strings_size = header->strings_size;
+		snapshot->strings_capacity = header->strings_size;
+		snapshot->mapping = data;
+		snapshot->mapping_size = size;
+		return SNAPSHOT_OK;
+	}
+
+	os_unmap_file(data, size);
+	return result;
+}
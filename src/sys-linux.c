@@ -1,7 +1,24 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <hollywood/plugin.h>
 
@@ -12,97 +29,1665 @@ extern hwPluginAPI *hwcl;
 
 extern void add_entry(void *state, const char *key, const char *value);
 
+double monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define DMI_PATH "/sys/devices/virtual/dmi/id/"
+
+// sysfs attributes are at most one page long
+#define ATTRIBUTE_SIZE 4096
+
 void fill_systable(void *state)
 {
-	APTR handle = hw_Lock("/sys/devices/virtual/dmi/id/", HWLOCKMODE_READ);
+	// reused for every attribute (one extra byte for the terminating NUL)
+	static char content[ATTRIBUTE_SIZE + 1];
 
-	if (handle != NULL)
+	struct dirent *entry = NULL;
+	DIR *dir = opendir(DMI_PATH);
+
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
 	{
-		APTR dirhandle;
-		int error = hw_BeginDirScan(handle, &dirhandle);
+		ssize_t read = 0;
+		ssize_t idx = 0;
+		int fd = -1;
 
-		if (error == 0)
+		if (entry->d_name[0] == '.')
 		{
-			int ok = FALSE;
+			continue;
+		}
 
-			for (;;)
-			{
-				struct hwos_ExLockStruct exlock;
-				exlock.Size = sizeof(struct hwos_ExLockStruct);
+		// subsystem and power entries are directories (or links to)
+		if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+		{
+			continue;
+		}
 
-				ok = hw_NextDirEntry(handle, dirhandle, &exlock);
+		// root-only attributes (product_serial, board_serial...) fail here with EACCES, which is cheaper than checking
+		// their permissions beforehand
+		fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_CLOEXEC);
 
-				if (ok == FALSE)
+		if (fd < 0)
+		{
+			continue;
+		}
+
+		// fails with EISDIR on directories reported as DT_UNKNOWN
+		read = pread(fd, content, ATTRIBUTE_SIZE, 0);
+
+		close(fd);
+
+		if (read > 1)
+		{
+			// keep first line only (a leading newline is kept, as it always has been)
+			content[read] = '\0';
+
+			for (idx = 1; idx < read; ++idx)
+			{
+				if (content[idx] == '\n' || content[idx] == '\r' || content[idx] == '\0')
 				{
+					content[idx] = '\0';
 					break;
 				}
+			}
 
-				if (exlock.Type == HWEXLOCKTYPE_FILE)
-				{
-					//printf("DirEntry : %s\n", exlock.Name);
-					unsigned char fullname[1024] = "/sys/devices/virtual/dmi/id/";
-					ok = hw_AddPart(fullname, exlock.Name, 1024);
+			add_entry(state, entry->d_name, content);
+		}
+	}
+
+	closedir(dir);
+}
+
+
+#define CPU_PATH "/sys/devices/system/cpu/"
+
+/* Reads a whole (small) sysfs/procfs file into value, stripped from its trailing newline
+** Returns the length of value or -1 if file can't be read */
+static int read_attribute(const char *path, char *value, size_t size)
+{
+	ssize_t read = 0;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
 
-					if (ok == TRUE)
-					{
-						//printf("FullName : %s\n", fullname);
+	if (fd < 0)
+	{
+		return -1;
+	}
 
-						APTR rd = hw_FOpen(fullname, HWFOPENMODE_READ_NEW);
+	read = pread(fd, value, size - 1, 0);
 
-						if (rd != NULL)
-						{
-							//printf("Opened file\n");
+	close(fd);
 
-							struct hwos_StatStruct st;
-							if (hw_FStat(rd, 0, &st, NULL) == TRUE)
-							{
-								//printf("FStat OK : size=%lld\n", st.Size);
+	if (read < 0)
+	{
+		return -1;
+	}
 
-								if (st.Size > 0)
-								{
-									char *content = malloc(st.Size * sizeof(char));
-									memset(content, 0, st.Size * sizeof(char));
+	while (read > 0 && (value[read - 1] == '\n' || value[read - 1] == '\r'))
+	{
+		--read;
+	}
 
-									int read = hw_FRead(rd, content, st.Size);
+	value[read] = '\0';
 
-									if (read > 1)
-									{
-										//printf("FRead OK : read=%d\n", read);
+	return (int)read;
+}
 
-										int idx = strlen(content) - 1;
+/* Counts CPUs of a list such as "0-3,8,10-11" */
+static int count_cpu_list(const char *list)
+{
+	int count = 0;
 
-										while (idx > 0)
-										{
-											if (content[idx] == '\n' || content[idx] == '\r')
-											{
-												content[idx] = '\0';
-											}
+	while (*list != '\0')
+	{
+		char *end = NULL;
+		long first = strtol(list, &end, 10);
+		long last = first;
 
-											--idx;
-										}
+		if (end == list)
+		{
+			break;
+		}
 
-										//printf("FRead content : %s\n", content);
-                                        add_entry(state, exlock.Name, content);
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+		}
 
-									}
+		count += (int)(last - first + 1);
+		list = (*end == ',') ? end + 1 : end;
+	}
 
-									free(content);
-								}
+	return count;
+}
 
-							}
+/* Parses a size such as "32K" or "16M" into bytes */
+static uint32_t parse_size(const char *value)
+{
+	char *end = NULL;
+	uint32_t size = (uint32_t)strtoul(value, &end, 10);
 
-							hw_FClose(rd);
-						}
-					}
-				}
+	switch (*end)
+	{
+	case 'K': return size * 1024;
+	case 'M': return size * 1024 * 1024;
+	case 'G': return size * 1024 * 1024 * 1024;
+	default:  return size;
+	}
+}
+
+int os_caches(cache_level_t *caches, int max)
+{
+	char path[128];
+	char value[256];
+	int count = 0;
+	int index = 0;
+
+	for (index = 0; count < max; ++index)
+	{
+		cache_level_t *cache = &caches[count];
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/level", index);
+
+		if (read_attribute(path, value, sizeof(value)) <= 0)
+		{
+			break;
+		}
+
+		memset(cache, 0, sizeof(*cache));
+		cache->level = atoi(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/type", index);
+		read_attribute(path, value, sizeof(value));
+
+		if (strcmp(value, "Data") == 0)
+		{
+			cache->type = CACHE_DATA;
+		}
+		else if (strcmp(value, "Instruction") == 0)
+		{
+			cache->type = CACHE_INSTRUCTION;
+		}
+		else if (strcmp(value, "Unified") == 0)
+		{
+			cache->type = CACHE_UNIFIED;
+		}
+		else
+		{
+			continue;
+		}
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/size", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->size = parse_size(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/ways_of_associativity", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->ways = atoi(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/coherency_line_size", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->line_size = atoi(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/number_of_sets", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->sets = atoi(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/physical_line_partition", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->partitions = atoi(value);
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu0/cache/index%d/shared_cpu_list", index);
+		if (read_attribute(path, value, sizeof(value)) > 0) cache->sharing = count_cpu_list(value);
+
+		++count;
+	}
+
+	return count;
+}
+
+/* Reads an integer sysfs attribute of a CPU, returns fallback if it doesn't exist */
+static int read_cpu_number(int cpu, const char *name, int fallback)
+{
+	char path[128];
+	char value[32];
+
+	snprintf(path, sizeof(path), CPU_PATH "cpu%d/%s", cpu, name);
+
+	if (read_attribute(path, value, sizeof(value)) <= 0)
+	{
+		return fallback;
+	}
+
+	return atoi(value);
+}
+
+/* Returns the rank of cpu in a list such as "2,10" or "2-3" (0 if not found) */
+static int rank_in_cpu_list(const char *list, int cpu)
+{
+	int rank = 0;
+
+	while (*list != '\0')
+	{
+		char *end = NULL;
+		long first = strtol(list, &end, 10);
+		long last = first;
+
+		if (end == list)
+		{
+			break;
+		}
+
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+		}
+
+		if (cpu >= first && cpu <= last)
+		{
+			return rank + (int)(cpu - first);
+		}
+
+		rank += (int)(last - first + 1);
+		list = (*end == ',') ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+/* Returns the highest CPU of a list such as "0-7" or "0,2-3" (-1 if list is empty) */
+static int last_cpu_in_list(const char *list)
+{
+	const char *last = list;
+	const char *c = NULL;
+
+	for (c = list; *c != '\0'; ++c)
+	{
+		if (*c == '-' || *c == ',')
+		{
+			last = c + 1;
+		}
+	}
+
+	return (*last >= '0' && *last <= '9') ? atoi(last) : -1;
+}
+
+/* Returns the NUMA node a CPU belongs to, looking for its nodeN link */
+static int cpu_node(int cpu)
+{
+	char path[128];
+	struct dirent *entry = NULL;
+	DIR *dir = NULL;
+	int node = -1;
+
+	snprintf(path, sizeof(path), CPU_PATH "cpu%d", cpu);
+
+	dir = opendir(path);
+
+	if (dir == NULL)
+	{
+		return -1;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+		{
+			node = atoi(entry->d_name + 4);
+			break;
+		}
+	}
+
+	closedir(dir);
+
+	// kernels built without NUMA support have no link : everything is in node 0
+	if (node < 0 && access("/sys/devices/system/node", F_OK) != 0)
+	{
+		node = 0;
+	}
+
+	return node;
+}
+
+int os_topology(logical_cpu_t **cpus)
+{
+	char path[128];
+	char value[256];
+	int count = 0;
+	int cpu = 0;
+
+	*cpus = NULL;
+
+	if (read_attribute(CPU_PATH "possible", value, sizeof(value)) <= 0)
+	{
+		return 0;
+	}
+
+	// "possible" is a list such as "0-7" : last CPU + 1 gives the array size
+	count = last_cpu_in_list(value) + 1;
+
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	*cpus = calloc(count, sizeof(logical_cpu_t));
+
+	if (*cpus == NULL)
+	{
+		return 0;
+	}
+
+	for (cpu = 0; cpu < count; ++cpu)
+	{
+		logical_cpu_t *logical = &(*cpus)[cpu];
+
+		logical->cpu = cpu;
+
+		// cpu0 usually can't be put offline and thus has no "online" attribute
+		snprintf(path, sizeof(path), CPU_PATH "cpu%d", cpu);
+		logical->online = read_cpu_number(cpu, "online", access(path, F_OK) == 0 ? 1 : 0);
+		logical->package = read_cpu_number(cpu, "topology/physical_package_id", -1);
+		logical->die = read_cpu_number(cpu, "topology/die_id", 0);
+		logical->core = read_cpu_number(cpu, "topology/core_id", -1);
+		logical->node = cpu_node(cpu);
+		logical->thread = 0;
+		logical->l3_group = -1;
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu%d/topology/thread_siblings_list", cpu);
+		if (read_attribute(path, value, sizeof(value)) > 0)
+		{
+			logical->thread = rank_in_cpu_list(value, cpu);
+		}
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu%d/cache/index3/shared_cpu_list", cpu);
+		if (read_attribute(path, value, sizeof(value)) > 0)
+		{
+			logical->l3_group = atoi(value);
+		}
+	}
+
+	return count;
+}
+
+int os_cpu_count(void)
+{
+	char value[256];
+	int count = 0;
+
+	if (read_attribute(CPU_PATH "possible", value, sizeof(value)) > 0)
+	{
+		count = last_cpu_in_list(value) + 1;
+	}
+
+	if (count <= 0)
+	{
+		count = (int)sysconf(_SC_NPROCESSORS_CONF);
+	}
+
+	return (count > 0) ? count : 1;
+}
+
+/* Reads a decimal number, skipping leading blanks */
+static const char *parse_u64(const char *p, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	while (*p == ' ' || *p == '\t')
+	{
+		++p;
+	}
+
+	while (*p >= '0' && *p <= '9')
+	{
+		result = result * 10 + (uint64_t)(*p - '0');
+		++p;
+	}
+
+	*value = result;
+
+	return p;
+}
+
+static const char *next_line(const char *p)
+{
+	while (*p != '\0' && *p != '\n')
+	{
+		++p;
+	}
+
+	return (*p == '\n') ? p + 1 : p;
+}
+
+// collectors share kept files and buffers : the monitor thread and the script thread may call them at the same time
+static pthread_mutex_t collect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// descriptors of files polled at high frequency are kept open and registered here to be closed by os_release()
+#define MAX_KEPT_FILES 256
+
+static int *kept_files[MAX_KEPT_FILES];
+static int kept_count = 0;
+
+/* Reads a file whose descriptor is kept open in *fd between calls (opened on first call)
+** Returns the number of bytes read into buffer (NUL terminated) or -1 */
+static ssize_t read_kept_file(int *fd, const char *path, char *buffer, size_t size)
+{
+	ssize_t read = 0;
+
+	if (*fd < 0)
+	{
+		// too many files : read this one without keeping it open
+		if (kept_count == MAX_KEPT_FILES)
+		{
+			int once = open(path, O_RDONLY | O_CLOEXEC);
+
+			if (once < 0)
+			{
+				return -1;
 			}
 
-			hw_EndDirScan(dirhandle);
+			read = pread(once, buffer, size - 1, 0);
+			close(once);
+			buffer[(read > 0) ? read : 0] = '\0';
+
+			return read;
+		}
+
+		*fd = open(path, O_RDONLY | O_CLOEXEC);
+
+		if (*fd < 0)
+		{
+			return -1;
+		}
+
+		kept_files[kept_count++] = fd;
+	}
+
+	read = pread(*fd, buffer, size - 1, 0);
+
+	if (read < 0)
+	{
+		return -1;
+	}
+
+	buffer[read] = '\0';
+
+	return read;
+}
+
+static void close_kept_files(void)
+{
+	int i = 0;
+
+	for (i = 0; i < kept_count; ++i)
+	{
+		close(*kept_files[i]);
+		*kept_files[i] = -1;
+	}
+
+	kept_count = 0;
+}
+
+// /proc/stat is kept open and read again from its beginning on every call
+static int stat_fd = -1;
+static char *stat_buffer = NULL;
+static size_t stat_size = 0;
+
+static int read_cpu_times(cpu_times_t *times, int max)
+{
+	const char *p = NULL;
+	ssize_t read = 0;
+	int count = 0;
+
+	if (stat_buffer == NULL)
+	{
+		// cpu lines come first and are less than 256 bytes long, the rest (intr, ctxt, ...) is not needed
+		stat_size = 256 * (size_t)(os_cpu_count() + 1) + 1;
+		stat_buffer = malloc(stat_size);
+
+		if (stat_buffer == NULL)
+		{
+			return 0;
+		}
+	}
+
+	read = read_kept_file(&stat_fd, "/proc/stat", stat_buffer, stat_size);
+
+	if (read <= 0)
+	{
+		return 0;
+	}
+
+	for (p = stat_buffer; count < max && p[0] == 'c' && p[1] == 'p' && p[2] == 'u'; p = next_line(p))
+	{
+		cpu_times_t *entry = &times[count];
+
+		// last line may have been truncated by the buffer size
+		if (next_line(p)[-1] != '\n')
+		{
+			break;
+		}
+
+		p += 3;
+
+		if (*p >= '0' && *p <= '9')
+		{
+			uint64_t cpu = 0;
+			p = parse_u64(p, &cpu);
+			entry->cpu = (int)cpu;
+		}
+		else
+		{
+			entry->cpu = -1;
 		}
 
-		hw_UnLock(handle);
+		p = parse_u64(p, &entry->user);
+		p = parse_u64(p, &entry->nice);
+		p = parse_u64(p, &entry->system);
+		p = parse_u64(p, &entry->idle);
+		p = parse_u64(p, &entry->iowait);
+		p = parse_u64(p, &entry->irq);
+		p = parse_u64(p, &entry->softirq);
+		p = parse_u64(p, &entry->steal);
 
+		++count;
 	}
 
+	return count;
+}
+
+int os_cpu_times(cpu_times_t *times, int max)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&collect_lock);
+	result = read_cpu_times(times, max);
+	pthread_mutex_unlock(&collect_lock);
+
+	return result;
+}
+
+/* Fields of /proc/meminfo (and nodeN/meminfo) we are interested in, with precomputed key lengths */
+typedef struct
+{
+	const char *key;
+	size_t length;
+	size_t offset;
+	uint64_t scale;     // 1024 for values in kB
+
+} meminfo_field_t;
+
+#define FIELD(key, member) { key, sizeof(key) - 1, offsetof(meminfo_t, member), 1024 }
+
+static const meminfo_field_t MemInfoFields[] =
+{
+	FIELD("MemTotal",     total),
+	FIELD("MemFree",      free),
+	FIELD("MemAvailable", available),
+	FIELD("Buffers",      buffers),
+	FIELD("Cached",       cached),
+	FIELD("SwapTotal",    swap_total),
+	FIELD("SwapFree",     swap_free),
+	{ NULL, 0, 0, 0 }
+};
+
+#undef FIELD
+
+/* Parses "Key:   value kB" lines, storing values (in bytes when in kB) of known keys into info */
+static void parse_meminfo(const char *p, const meminfo_field_t *fields, void *info)
+{
+	for ( ; *p != '\0'; p = next_line(p))
+	{
+		const meminfo_field_t *field = NULL;
+		const char *colon = p;
+		uint64_t value = 0;
+
+		// node meminfo lines start with "Node N "
+		if (p[0] == 'N' && p[1] == 'o' && p[2] == 'd' && p[3] == 'e' && p[4] == ' ')
+		{
+			p = parse_u64(p + 5, &value);
+			while (*p == ' ') ++p;
+		}
+
+		while (*colon != ':' && *colon != '\n' && *colon != '\0')
+		{
+			++colon;
+		}
+
+		if (*colon != ':')
+		{
+			continue;
+		}
+
+		for (field = fields; field->key != NULL; ++field)
+		{
+			if ((size_t)(colon - p) == field->length && memcmp(p, field->key, field->length) == 0)
+			{
+				parse_u64(colon + 1, &value);
+				*(uint64_t *)((char *)info + field->offset) = value * field->scale;
+				break;
+			}
+		}
+	}
+}
+
+typedef struct
+{
+	uint64_t total;
+	uint64_t free;
+
+} node_meminfo_t;
+
+static const meminfo_field_t NodeMemInfoFields[] =
+{
+	{ "MemTotal", 8, offsetof(node_meminfo_t, total), 1024 },
+	{ "MemFree",  7, offsetof(node_meminfo_t, free), 1024 },
+	{ NULL, 0, 0, 0 }
+};
+
+#define HUGEPAGES_PATH "/sys/kernel/mm/hugepages/"
+#define NODE_PATH      "/sys/devices/system/node/"
+
+// hugepage sizes and NUMA nodes are discovered once, their files are then kept open
+static int meminfo_discovered = FALSE;
+static int meminfo_fd = -1;
+static int thp_fd = -1;
+static int hugepage_sizes = 0;
+static uint64_t hugepage_size[MAX_HUGEPAGE_SIZES];
+static int hugepage_fds[MAX_HUGEPAGE_SIZES][4];
+static int nodes = 0;
+static int node_id[MAX_NUMA_NODES];
+static int node_fds[MAX_NUMA_NODES];
+
+static int compare_int(const void *arg1, const void *arg2)
+{
+	return *(const int *)arg1 - *(const int *)arg2;
+}
+
+static void discover_meminfo(void)
+{
+	struct dirent *entry = NULL;
+	DIR *dir = NULL;
+	int i = 0;
+
+	hugepage_sizes = 0;
+	nodes = 0;
+
+	dir = opendir(HUGEPAGES_PATH);
+
+	if (dir != NULL)
+	{
+		while ((entry = readdir(dir)) != NULL && hugepage_sizes < MAX_HUGEPAGE_SIZES)
+		{
+			// hugepages-2048kB
+			if (strncmp(entry->d_name, "hugepages-", 10) == 0)
+			{
+				hugepage_size[hugepage_sizes] = strtoull(entry->d_name + 10, NULL, 10) * 1024;
+				for (i = 0; i < 4; ++i) hugepage_fds[hugepage_sizes][i] = -1;
+				++hugepage_sizes;
+			}
+		}
+
+		closedir(dir);
+	}
+
+	dir = opendir(NODE_PATH);
+
+	if (dir != NULL)
+	{
+		while ((entry = readdir(dir)) != NULL && nodes < MAX_NUMA_NODES)
+		{
+			if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+			{
+				node_id[nodes] = atoi(entry->d_name + 4);
+				node_fds[nodes] = -1;
+				++nodes;
+			}
+		}
+
+		closedir(dir);
+
+		qsort(node_id, nodes, sizeof(int), compare_int);
+	}
+
+	meminfo_discovered = TRUE;
+}
+
+static int read_meminfo(meminfo_t *info)
+{
+	static const char *HugePageFiles[4] = { "nr_hugepages", "free_hugepages", "resv_hugepages", "surplus_hugepages" };
+	// /proc/meminfo is about 1.5KB, node meminfo a bit less
+	char buffer[4096];
+	char path[128];
+	int i = 0;
+	int j = 0;
+
+	memset(info, 0, sizeof(*info));
+
+	if (meminfo_discovered == FALSE)
+	{
+		discover_meminfo();
+	}
+
+	if (read_kept_file(&meminfo_fd, "/proc/meminfo", buffer, sizeof(buffer)) <= 0)
+	{
+		return FALSE;
+	}
+
+	parse_meminfo(buffer, MemInfoFields, info);
+
+	for (i = 0; i < hugepage_sizes; ++i)
+	{
+		uint64_t *values[4];
+
+		values[0] = &info->hugepages[i].total;
+		values[1] = &info->hugepages[i].free;
+		values[2] = &info->hugepages[i].reserved;
+		values[3] = &info->hugepages[i].surplus;
+
+		info->hugepages[i].size = hugepage_size[i];
+
+		for (j = 0; j < 4; ++j)
+		{
+			snprintf(path, sizeof(path), HUGEPAGES_PATH "hugepages-%llukB/%s", (unsigned long long)(hugepage_size[i] / 1024), HugePageFiles[j]);
+
+			if (read_kept_file(&hugepage_fds[i][j], path, buffer, 32) > 0)
+			{
+				parse_u64(buffer, values[j]);
+			}
+		}
+	}
+
+	info->hugepage_sizes = hugepage_sizes;
+
+	// "always [madvise] never" : selected mode is between brackets
+	if (read_kept_file(&thp_fd, "/sys/kernel/mm/transparent_hugepage/enabled", buffer, 64) > 0)
+	{
+		char *open_bracket = strchr(buffer, '[');
+		char *close_bracket = (open_bracket != NULL) ? strchr(open_bracket, ']') : NULL;
+
+		if (close_bracket != NULL && close_bracket - open_bracket - 1 < (int)sizeof(info->transparent_hugepage))
+		{
+			memcpy(info->transparent_hugepage, open_bracket + 1, close_bracket - open_bracket - 1);
+		}
+	}
+
+	for (i = 0; i < nodes; ++i)
+	{
+		node_meminfo_t node;
+
+		memset(&node, 0, sizeof(node));
+
+		snprintf(path, sizeof(path), NODE_PATH "node%d/meminfo", node_id[i]);
+
+		if (read_kept_file(&node_fds[i], path, buffer, sizeof(buffer)) > 0)
+		{
+			parse_meminfo(buffer, NodeMemInfoFields, &node);
+		}
+
+		info->node[i].node = node_id[i];
+		info->node[i].total = node.total;
+		info->node[i].free = node.free;
+	}
+
+	info->nodes = nodes;
+
+	return TRUE;
+}
+
+int os_meminfo(meminfo_t *info)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&collect_lock);
+	result = read_meminfo(info);
+	pthread_mutex_unlock(&collect_lock);
+
+	return result;
+}
+
+/* Limits of each CPU are read once, current frequencies are read from kept open files */
+typedef struct
+{
+	int probed;
+	int available;
+	uint32_t min_khz;
+	uint32_t max_khz;
+	int cur_fd;
+
+} cpufreq_file_t;
+
+static cpufreq_file_t *cpufreq_files = NULL;
+static int cpufreq_count = 0;
+
+static int read_cpu_freqs(cpu_freq_t *freqs, int max)
+{
+	char path[128];
+	char value[32];
+	int count = 0;
+	int cpu = 0;
+
+	if (cpufreq_files == NULL)
+	{
+		cpufreq_count = os_cpu_count();
+		cpufreq_files = calloc(cpufreq_count, sizeof(cpufreq_file_t));
+
+		if (cpufreq_files == NULL)
+		{
+			cpufreq_count = 0;
+			return 0;
+		}
+	}
+
+	for (cpu = 0; cpu < cpufreq_count && count < max; ++cpu)
+	{
+		cpufreq_file_t *file = &cpufreq_files[cpu];
+		uint64_t khz = 0;
+
+		if (file->probed == FALSE)
+		{
+			file->probed = TRUE;
+			file->cur_fd = -1;
+
+			snprintf(path, sizeof(path), CPU_PATH "cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+			if (read_attribute(path, value, sizeof(value)) > 0)
+			{
+				file->available = TRUE;
+				file->max_khz = (uint32_t)strtoul(value, NULL, 10);
+
+				snprintf(path, sizeof(path), CPU_PATH "cpu%d/cpufreq/cpuinfo_min_freq", cpu);
+				if (read_attribute(path, value, sizeof(value)) > 0)
+				{
+					file->min_khz = (uint32_t)strtoul(value, NULL, 10);
+				}
+			}
+		}
+
+		if (file->available == FALSE)
+		{
+			continue;
+		}
+
+		snprintf(path, sizeof(path), CPU_PATH "cpu%d/cpufreq/scaling_cur_freq", cpu);
+
+		// offline CPUs keep their cpufreq directory but can't be read
+		if (read_kept_file(&file->cur_fd, path, value, sizeof(value)) <= 0)
+		{
+			continue;
+		}
+
+		parse_u64(value, &khz);
+
+		freqs[count].cpu = cpu;
+		freqs[count].cur_khz = (uint32_t)khz;
+		freqs[count].min_khz = file->min_khz;
+		freqs[count].max_khz = file->max_khz;
+		++count;
+	}
+
+	return count;
+}
+
+int os_cpu_freqs(cpu_freq_t *freqs, int max)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&collect_lock);
+	result = read_cpu_freqs(freqs, max);
+	pthread_mutex_unlock(&collect_lock);
+
+	return result;
+}
+
+typedef struct
+{
+	void (*entry)(void *arg);
+	void *arg;
+	pthread_t thread;
+
+} os_thread_t;
+
+static void *thread_main(void *arg)
+{
+	os_thread_t *thread = (os_thread_t *)arg;
+
+	thread->entry(thread->arg);
+
+	return NULL;
+}
+
+void *os_thread_create(void (*entry)(void *arg), void *arg)
+{
+	os_thread_t *thread = malloc(sizeof(os_thread_t));
+
+	if (thread == NULL)
+	{
+		return NULL;
+	}
+
+	thread->entry = entry;
+	thread->arg = arg;
+
+	if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void os_thread_join(void *thread)
+{
+	pthread_join(((os_thread_t *)thread)->thread, NULL);
+	free(thread);
+}
+
+void os_yield(void)
+{
+	sched_yield();
+}
+
+void os_sleep(double seconds)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)seconds;
+	ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+
+	nanosleep(&ts, NULL);
+}
+
+const void *os_map_file(const char *filename, size_t *size)
+{
+	struct stat st;
+	void *data = MAP_FAILED;
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	// the mapping stays valid once the file is closed
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	*size = (size_t)st.st_size;
+	return data;
+}
+
+void os_unmap_file(const void *data, size_t size)
+{
+	munmap((void *)data, size);
+}
+
+#define CURRENT_CPU_UNKNOWN 0
+#define CURRENT_CPU_RDTSCP  1   // Linux keeps (node << 12) | cpu in the TSC_AUX register of each processor
+#define CURRENT_CPU_GETCPU  2   // sched_getcpu() (vDSO or rseq)
+
+// calls timed to choose between both ways
+#define CURRENT_CPU_PROBES 256
+
+static int current_cpu_source = CURRENT_CPU_UNKNOWN;
+
+static int rdtscp_cpu(void)
+{
+	unsigned int aux = 0;
+
+	__rdtscp(&aux);
+
+	return (int)(aux & 0xFFF);
+}
+
+/* Uses RDTSCP if TSC_AUX really holds the CPU number and it is cheaper than sched_getcpu() */
+static int current_cpu_choose(void)
+{
+	volatile int sink = 0;
+	uint64_t rdtscp_ticks = 0;
+	uint64_t getcpu_ticks = 0;
+	uint64_t start = 0;
+	int agree = FALSE;
+	int i = 0;
+
+	if (!feature_test(feature_set(), FEATURE_RDTSCP))
+	{
+		return CURRENT_CPU_GETCPU;
+	}
+
+	// the thread may be moved to another processor between both reads
+	for (i = 0; i < 8 && !agree; ++i)
+	{
+		agree = (rdtscp_cpu() == sched_getcpu());
+	}
+
+	if (!agree)
+	{
+		return CURRENT_CPU_GETCPU;
+	}
+
+	start = timer_ticks();
+
+	for (i = 0; i < CURRENT_CPU_PROBES; ++i)
+	{
+		sink += rdtscp_cpu();
+	}
+
+	rdtscp_ticks = timer_ticks() - start;
+	start = timer_ticks();
+
+	for (i = 0; i < CURRENT_CPU_PROBES; ++i)
+	{
+		sink += sched_getcpu();
+	}
+
+	getcpu_ticks = timer_ticks() - start;
+
+	return (rdtscp_ticks <= getcpu_ticks) ? CURRENT_CPU_RDTSCP : CURRENT_CPU_GETCPU;
+}
+
+int os_current_cpu(void)
+{
+	if (current_cpu_source == CURRENT_CPU_UNKNOWN)
+	{
+		current_cpu_source = current_cpu_choose();
+	}
+
+	if (current_cpu_source == CURRENT_CPU_RDTSCP)
+	{
+		return rdtscp_cpu();
+	}
+
+	return sched_getcpu();
+}
+
+int os_get_affinity(int *cpus, int max)
+{
+	int possible = os_cpu_count();
+	size_t size = CPU_ALLOC_SIZE(possible);
+	cpu_set_t *set = CPU_ALLOC(possible);
+	int count = 0;
+	int cpu = 0;
+
+	if (set == NULL)
+	{
+		return 0;
+	}
+
+	if (sched_getaffinity(0, size, set) == 0)
+	{
+		for (cpu = 0; cpu < possible && count < max; ++cpu)
+		{
+			if (CPU_ISSET_S(cpu, size, set))
+			{
+				cpus[count++] = cpu;
+			}
+		}
+	}
+
+	CPU_FREE(set);
+
+	return count;
+}
+
+int os_set_affinity(const int *cpus, int count)
+{
+	int possible = os_cpu_count();
+	size_t size = 0;
+	cpu_set_t *set = NULL;
+	int result = FALSE;
+	int i = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (cpus[i] < 0 || cpus[i] >= possible)
+		{
+			return FALSE;
+		}
+	}
+
+	size = CPU_ALLOC_SIZE(possible);
+	set = CPU_ALLOC(possible);
+
+	if (set == NULL)
+	{
+		return FALSE;
+	}
+
+	CPU_ZERO_S(size, set);
+
+	for (i = 0; i < count; ++i)
+	{
+		CPU_SET_S(cpus[i], size, set);
+	}
+
+	// 0 : calling thread only
+	result = (sched_setaffinity(0, size, set) == 0);
+
+	CPU_FREE(set);
+
+	return result;
+}
+
+typedef struct
+{
+	uint64_t threads;
+	uint64_t swap;
+	uint64_t peak_rss;
+
+} status_t;
+
+#define FIELD(key, member, scale) { key, sizeof(key) - 1, offsetof(status_t, member), scale }
+
+static const meminfo_field_t StatusFields[] =
+{
+	FIELD("Threads", threads,  1),
+	FIELD("VmSwap",  swap,     1024),
+	FIELD("VmHWM",   peak_rss, 1024),
+	{ NULL, 0, 0, 0 }
+};
+
+#undef FIELD
+
+#define FIELD(key, member) { key, sizeof(key) - 1, offsetof(process_info_t, member), 1 }
+
+static const meminfo_field_t IoFields[] =
+{
+	FIELD("rchar",       read_chars),
+	FIELD("wchar",       write_chars),
+	FIELD("syscr",       read_syscalls),
+	FIELD("syscw",       write_syscalls),
+	FIELD("read_bytes",  read_bytes),
+	FIELD("write_bytes", write_bytes),
+	{ NULL, 0, 0, 0 }
+};
+
+#undef FIELD
+
+static int statm_fd = -1;
+static int status_fd = -1;
+static int io_fd = -1;
+
+static int read_process_info(process_info_t *info)
+{
+	static uint64_t page_size = 0;
+	// /proc/self/status is about 1.5KB
+	char buffer[4096];
+	struct rusage usage;
+	status_t status;
+	int collected = FALSE;
+
+	memset(info, 0, sizeof(*info));
+	memset(&status, 0, sizeof(status));
+
+	if (page_size == 0)
+	{
+		page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+	}
+
+	// times, faults and context switches of all threads
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		info->user_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+		info->system_time = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		info->peak_rss = (uint64_t)usage.ru_maxrss * 1024;
+		info->minor_faults = usage.ru_minflt;
+		info->major_faults = usage.ru_majflt;
+		info->voluntary_switches = usage.ru_nvcsw;
+		info->involuntary_switches = usage.ru_nivcsw;
+		collected = TRUE;
+	}
+
+	// size resident shared text lib data dt (in pages)
+	if (read_kept_file(&statm_fd, "/proc/self/statm", buffer, 256) > 0)
+	{
+		uint64_t unused = 0;
+		const char *p = buffer;
+
+		p = parse_u64(p, &info->virtual_size);
+		p = parse_u64(p, &info->rss);
+		p = parse_u64(p, &info->shared);
+		p = parse_u64(p, &info->text);
+		p = parse_u64(p, &unused);
+		p = parse_u64(p, &info->data);
+
+		info->virtual_size *= page_size;
+		info->rss *= page_size;
+		info->shared *= page_size;
+		info->text *= page_size;
+		info->data *= page_size;
+		collected = TRUE;
+	}
+
+	if (read_kept_file(&status_fd, "/proc/self/status", buffer, sizeof(buffer)) > 0)
+	{
+		parse_meminfo(buffer, StatusFields, &status);
+
+		info->threads = (int)status.threads;
+		info->swap = status.swap;
+
+		if (status.peak_rss > info->peak_rss)
+		{
+			info->peak_rss = status.peak_rss;
+		}
+	}
+
+	// needs ptrace access to ourselves : may be denied by some security modules
+	if (read_kept_file(&io_fd, "/proc/self/io", buffer, 512) > 0)
+	{
+		parse_meminfo(buffer, IoFields, info);
+		info->io = TRUE;
+	}
+
+	return collected;
+}
+
+int os_process_info(process_info_t *info)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&collect_lock);
+	result = read_process_info(info);
+	pthread_mutex_unlock(&collect_lock);
+
+	return result;
+}
+
+/* perf_event_open() counters, in the order they are tried (first one opened is the group leader) */
+static const struct
+{
+	int counter;
+	uint32_t type;
+	uint64_t config;
+	int kernel;     // only happens in kernel mode : counting user space only would always give 0
+
+} PerfEvents[PERF_COUNTERS] =
+{
+	{ PERF_CYCLES,           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       FALSE },
+	{ PERF_INSTRUCTIONS,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     FALSE },
+	{ PERF_CACHE_REFERENCES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, FALSE },
+	{ PERF_CACHE_MISSES,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     FALSE },
+	{ PERF_BRANCH_MISSES,    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    FALSE },
+	// software events stay available when the PMU is not (perf_event_paranoid, virtual machines)
+	{ PERF_TASK_CLOCK,       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,       FALSE },
+	{ PERF_CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, TRUE }
+};
+
+static int perf_fds[PERF_COUNTERS];
+static int perf_slots[PERF_COUNTERS];  // counter read at each position of the group
+static int perf_opened = 0;
+static int perf_tried = FALSE;
+static uint32_t perf_mask = 0;
+static int perf_rusage_switches = FALSE;  // context switches taken from getrusage() instead
+
+static int perf_event_open(struct perf_event_attr *attr, int group)
+{
+	return (int)syscall(__NR_perf_event_open, attr, 0, -1, group, 0);
+}
+
+uint32_t os_perf_open(void)
+{
+	struct perf_event_attr attr;
+	int i = 0;
+
+	if (perf_tried)
+	{
+		return perf_mask;
+	}
+
+	perf_tried = TRUE;
+
+	for (i = 0; i < PERF_COUNTERS; ++i)
+	{
+		int fd = -1;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PerfEvents[i].type;
+		attr.config = PerfEvents[i].config;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		// user space only : allowed up to perf_event_paranoid 2 (kernel events need 1 or less)
+		attr.exclude_kernel = !PerfEvents[i].kernel;
+		attr.exclude_hv = 1;
+		// the whole group is started at once below
+		attr.disabled = (perf_opened == 0);
+
+		fd = perf_event_open(&attr, (perf_opened == 0) ? -1 : perf_fds[0]);
+
+		if (fd >= 0)
+		{
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+			perf_fds[perf_opened] = fd;
+			perf_slots[perf_opened] = PerfEvents[i].counter;
+			++perf_opened;
+			perf_mask |= 1 << PerfEvents[i].counter;
+		}
+		else if (PerfEvents[i].counter == PERF_CONTEXT_SWITCHES)
+		{
+			// the scheduler counts them for every thread anyway
+			perf_rusage_switches = TRUE;
+			perf_mask |= 1 << PERF_CONTEXT_SWITCHES;
+		}
+	}
+
+	if (perf_opened > 0)
+	{
+		ioctl(perf_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	return perf_mask;
+}
+
+int os_perf_read(perf_sample_t *sample)
+{
+	// nr, time_enabled, time_running then one value per counter of the group
+	uint64_t buffer[3 + PERF_COUNTERS];
+	uint64_t i = 0;
+
+	memset(sample, 0, sizeof(*sample));
+
+	if (perf_rusage_switches)
+	{
+		struct rusage usage;
+
+		if (getrusage(RUSAGE_THREAD, &usage) == 0)
+		{
+			sample->values[PERF_CONTEXT_SWITCHES] = (uint64_t)usage.ru_nvcsw + (uint64_t)usage.ru_nivcsw;
+		}
+	}
+
+	// one read() on the leader returns every counter of the group, all sampled at the same time
+	if (perf_opened == 0 || read(perf_fds[0], buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t)))
+	{
+		return perf_rusage_switches;
+	}
+
+	// scaling is left to the caller : the ratio of two reads differs when counters are multiplexed meanwhile
+	sample->time_enabled = buffer[1];
+	sample->time_running = buffer[2];
+
+	for (i = 0; i < buffer[0] && i < (uint64_t)perf_opened; ++i)
+	{
+		sample->values[perf_slots[i]] = buffer[3 + i];
+		sample->grouped |= 1 << perf_slots[i];
+	}
+
+	return TRUE;
+}
+
+static void perf_close(void)
+{
+	int i = 0;
+
+	// members first, leader last
+	for (i = perf_opened - 1; i >= 0; --i)
+	{
+		close(perf_fds[i]);
+	}
+
+	perf_opened = 0;
+	perf_tried = FALSE;
+	perf_mask = 0;
+	perf_rusage_switches = FALSE;
+}
+
+#define BLOCK_PATH "/sys/block/"
+
+static uint32_t read_block_number(const char *disk, const char *attribute)
+{
+	char path[256];
+	char value[64];
+
+	snprintf(path, sizeof(path), BLOCK_PATH "%s/%s", disk, attribute);
+
+	if (read_attribute(path, value, sizeof(value)) <= 0)
+	{
+		return 0;
+	}
+
+	return (uint32_t)strtoul(value, NULL, 10);
+}
+
+/* Copies the active scheduler of a list such as "mq-deadline kyber [bfq] none" */
+static void active_scheduler(const char *list, char *scheduler, size_t size)
+{
+	const char *start = strchr(list, '[');
+	const char *end = (start != NULL) ? strchr(start, ']') : NULL;
+	size_t length = 0;
+
+	if (start != NULL && end != NULL)
+	{
+		++start;
+	}
+	else
+	{
+		// a single scheduler isn't bracketed
+		start = list;
+		end = list + strlen(list);
+	}
+
+	length = (size_t)(end - start);
+
+	if (length >= size)
+	{
+		length = size - 1;
+	}
+
+	memcpy(scheduler, start, length);
+	scheduler[length] = '\0';
+}
+
+static void read_disk(const char *name, disk_info_t *disk)
+{
+	char path[256];
+	char value[256];
+	uint64_t sectors = 0;
+	int length = 0;
+
+	memset(disk, 0, sizeof(*disk));
+	snprintf(disk->name, sizeof(disk->name), "%s", name);
+
+	snprintf(path, sizeof(path), BLOCK_PATH "%s/size", name);
+
+	if (read_attribute(path, value, sizeof(value)) > 0)
+	{
+		parse_u64(value, &sectors);
+	}
+
+	// always counted in 512 bytes sectors, whatever the block size
+	disk->size = sectors * 512;
+
+	disk->rotational = read_block_number(name, "queue/rotational");
+	disk->removable = read_block_number(name, "removable");
+	disk->logical_block_size = read_block_number(name, "queue/logical_block_size");
+	disk->physical_block_size = read_block_number(name, "queue/physical_block_size");
+	disk->queue_depth = read_block_number(name, "device/queue_depth");
+	disk->nr_requests = read_block_number(name, "queue/nr_requests");
+	disk->read_ahead = read_block_number(name, "queue/read_ahead_kb") * 1024;
+
+	snprintf(path, sizeof(path), BLOCK_PATH "%s/queue/scheduler", name);
+
+	if (read_attribute(path, value, sizeof(value)) > 0)
+	{
+		active_scheduler(value, disk->scheduler, sizeof(disk->scheduler));
+	}
+
+	// padded with spaces by SCSI devices
+	snprintf(path, sizeof(path), BLOCK_PATH "%s/device/model", name);
+	length = read_attribute(path, disk->model, sizeof(disk->model));
+
+	while (length > 0 && disk->model[length - 1] == ' ')
+	{
+		disk->model[--length] = '\0';
+	}
+}
+
+int os_disks(disk_info_t **disks)
+{
+	struct dirent *entry = NULL;
+	DIR *dir = opendir(BLOCK_PATH);
+	int capacity = 0;
+	int count = 0;
+
+	*disks = NULL;
+
+	if (dir == NULL)
+	{
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		if (count == capacity)
+		{
+			disk_info_t *grown = NULL;
+
+			capacity = (capacity == 0) ? 16 : 2 * capacity;
+			grown = realloc(*disks, capacity * sizeof(disk_info_t));
+
+			if (grown == NULL)
+			{
+				break;
+			}
+
+			*disks = grown;
+		}
+
+		read_disk(entry->d_name, &(*disks)[count]);
+
+		// unused loop and ram devices
+		if ((*disks)[count].size > 0)
+		{
+			++count;
+		}
+	}
+
+	closedir(dir);
+
+	return count;
+}
+
+// /proc/diskstats is kept open and parsed from a fixed buffer (about 150 bytes per device)
+#define DISKSTATS_SIZE (MAX_DISKS * 160)
+
+static int diskstats_fd = -1;
+static char diskstats_buffer[DISKSTATS_SIZE];
+
+static int read_disk_counters(disk_counters_t *counters, int max)
+{
+	const char *p = NULL;
+	int count = 0;
+
+	if (read_kept_file(&diskstats_fd, "/proc/diskstats", diskstats_buffer, sizeof(diskstats_buffer)) <= 0)
+	{
+		return 0;
+	}
+
+	for (p = diskstats_buffer; *p != '\0' && count < max; p = next_line(p))
+	{
+		disk_counters_t *entry = &counters[count];
+		uint64_t ignored = 0;
+		size_t length = 0;
+
+		// last line may have been truncated by the buffer size
+		if (next_line(p)[-1] != '\n')
+		{
+			break;
+		}
+
+		// major and minor numbers
+		p = parse_u64(p, &ignored);
+		p = parse_u64(p, &ignored);
+
+		while (*p == ' ' || *p == '\t')
+		{
+			++p;
+		}
+
+		while (p[length] != ' ' && p[length] != '\t' && p[length] != '\n' && p[length] != '\0')
+		{
+			++length;
+		}
+
+		if (length == 0 || length >= sizeof(entry->name))
+		{
+			continue;
+		}
+
+		memcpy(entry->name, p, length);
+		entry->name[length] = '\0';
+		p += length;
+
+		p = parse_u64(p, &entry->reads);
+		p = parse_u64(p, &ignored);
+		p = parse_u64(p, &entry->read_sectors);
+		p = parse_u64(p, &entry->read_ms);
+		p = parse_u64(p, &entry->writes);
+		p = parse_u64(p, &ignored);
+		p = parse_u64(p, &entry->write_sectors);
+		p = parse_u64(p, &entry->write_ms);
+		p = parse_u64(p, &entry->in_flight);
+		p = parse_u64(p, &entry->io_ms);
+		p = parse_u64(p, &entry->queue_ms);
+
+		// devices never used (most loop and ram devices)
+		if (entry->reads != 0 || entry->writes != 0 || entry->in_flight != 0)
+		{
+			++count;
+		}
+	}
+
+	return count;
+}
+
+int os_disk_counters(disk_counters_t *counters, int max)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&collect_lock);
+	result = read_disk_counters(counters, max);
+	pthread_mutex_unlock(&collect_lock);
+
+	return result;
+}
+
+void os_release(void)
+{
+	pthread_mutex_lock(&collect_lock);
+
+	close_kept_files();
+
+	meminfo_discovered = FALSE;
+
+	free(cpufreq_files);
+	cpufreq_files = NULL;
+	cpufreq_count = 0;
+
+	free(stat_buffer);
+	stat_buffer = NULL;
+	stat_size = 0;
+
+	pthread_mutex_unlock(&collect_lock);
 
-}
\ No newline at end of file
+	perf_close();
+}
@@ -1,14 +1,37 @@
-#define _WIN32_WINNT 0x0400
+// GetLogicalProcessorInformationEx() and processor groups need Windows 7
+#define _WIN32_WINNT 0x0601
 #define _WIN32_DCOM
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <windows.h>
+#include <psapi.h>
+#include <powrprof.h>
 #include <wbemidl.h>
+#include <winioctl.h>
+
+#include "sfpplugin.h"
 
 extern void new_table(void *state, const char *name);
 extern void add_entry(void *state, const char *key, const char *value);
 extern void close_table(void *state);
 
+double monotonic_seconds(void)
+{
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
 #define get_component(component) \
 {\
     VARIANT component;\
@@ -195,3 +218,856 @@ void fill_systable(void *state)
     // unwind everything else we've allocated
     CoUninitialize();
 }
+
+/* Returns what GetLogicalProcessorInformation() reports (in a malloc'ed buffer), NULL on failure */
+static SYSTEM_LOGICAL_PROCESSOR_INFORMATION *processor_information(int *count)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = NULL;
+    DWORD size = 0;
+
+    *count = 0;
+
+    if (GetLogicalProcessorInformation(NULL, &size) || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        return NULL;
+    }
+
+    info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *)malloc(size);
+
+    if (info == NULL || !GetLogicalProcessorInformation(info, &size))
+    {
+        free(info);
+        return NULL;
+    }
+
+    *count = (int)(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+    return info;
+}
+
+static int count_bits(ULONG_PTR mask)
+{
+    int count = 0;
+
+    for (; mask != 0; mask &= mask - 1)
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+int os_caches(cache_level_t *caches, int max)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = NULL;
+    int entries = 0;
+    int count = 0;
+    int i = 0;
+
+    info = processor_information(&entries);
+
+    for (i = 0; i < entries && count < max; ++i)
+    {
+        const CACHE_DESCRIPTOR *descriptor = &info[i].Cache;
+        cache_level_t *cache = &caches[count];
+
+        // caches of the first processor, as under Linux
+        if (info[i].Relationship != RelationCache || (info[i].ProcessorMask & 1) == 0)
+        {
+            continue;
+        }
+
+        memset(cache, 0, sizeof(*cache));
+
+        switch (descriptor->Type)
+        {
+        case CacheData:        cache->type = CACHE_DATA; break;
+        case CacheInstruction: cache->type = CACHE_INSTRUCTION; break;
+        case CacheUnified:     cache->type = CACHE_UNIFIED; break;
+        default:               continue;
+        }
+
+        cache->level = descriptor->Level;
+        cache->size = descriptor->Size;
+        cache->line_size = descriptor->LineSize;
+        cache->sharing = count_bits(info[i].ProcessorMask);
+        cache->partitions = 1;
+
+        // 0xFF : fully associative
+        cache->ways = (descriptor->Associativity == CACHE_FULLY_ASSOCIATIVE) ? 0 : descriptor->Associativity;
+
+        if (cache->ways > 0 && cache->line_size > 0)
+        {
+            cache->sets = (int)(cache->size / (cache->ways * cache->line_size));
+        }
+
+        ++count;
+    }
+
+    free(info);
+
+    return count;
+}
+
+static SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *processor_information_ex(DWORD *size)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *info = NULL;
+
+    *size = 0;
+
+    if (GetLogicalProcessorInformationEx(RelationAll, NULL, size) || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        return NULL;
+    }
+
+    info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)malloc(*size);
+
+    if (info == NULL || !GetLogicalProcessorInformationEx(RelationAll, info, size))
+    {
+        free(info);
+        *size = 0;
+        return NULL;
+    }
+
+    return info;
+}
+
+// processors are numbered as Windows does : groups one after the other
+static int group_base(WORD group)
+{
+    int base = 0;
+    WORD i = 0;
+
+    for (i = 0; i < group; ++i)
+    {
+        base += (int)GetMaximumProcessorCount(i);
+    }
+
+    return base;
+}
+
+// calls set(cpu, rank, value) for every processor of mask, rank being its position in mask
+static void for_each_cpu(logical_cpu_t *cpus, int count, const GROUP_AFFINITY *affinity, void (*set)(logical_cpu_t *, int, int), int value)
+{
+    int base = group_base(affinity->Group);
+    int rank = 0;
+    int bit = 0;
+
+    for (bit = 0; bit < (int)(8 * sizeof(KAFFINITY)); ++bit)
+    {
+        if (((affinity->Mask >> bit) & 1) && base + bit < count)
+        {
+            set(&cpus[base + bit], rank++, value);
+        }
+    }
+}
+
+static int first_cpu(const GROUP_AFFINITY *affinity)
+{
+    int bit = 0;
+
+    for (bit = 0; bit < (int)(8 * sizeof(KAFFINITY)); ++bit)
+    {
+        if ((affinity->Mask >> bit) & 1)
+        {
+            return group_base(affinity->Group) + bit;
+        }
+    }
+
+    return -1;
+}
+
+static void set_core(logical_cpu_t *cpu, int rank, int core)
+{
+    cpu->online = 1;
+    cpu->core = core;
+    cpu->thread = rank;
+}
+
+static void set_package(logical_cpu_t *cpu, int rank, int package)
+{
+    cpu->package = package;
+}
+
+static void set_node(logical_cpu_t *cpu, int rank, int node)
+{
+    cpu->node = node;
+}
+
+static void set_l3_group(logical_cpu_t *cpu, int rank, int first)
+{
+    cpu->l3_group = first;
+}
+
+int os_topology(logical_cpu_t **cpus)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *info = NULL;
+    const BYTE *entry = NULL;
+    DWORD size = 0;
+    int count = 0;
+    int cores = 0;
+    int packages = 0;
+    int cpu = 0;
+    WORD i = 0;
+
+    *cpus = NULL;
+
+    count = (int)GetMaximumProcessorCount(ALL_PROCESSOR_GROUPS);
+    info = processor_information_ex(&size);
+
+    if (count <= 0 || info == NULL)
+    {
+        free(info);
+        return 0;
+    }
+
+    *cpus = (logical_cpu_t *)calloc(count, sizeof(logical_cpu_t));
+
+    if (*cpus == NULL)
+    {
+        free(info);
+        return 0;
+    }
+
+    // processors which don't appear in any core (not started yet) stay offline
+    for (cpu = 0; cpu < count; ++cpu)
+    {
+        logical_cpu_t *logical = &(*cpus)[cpu];
+
+        logical->cpu = cpu;
+        logical->online = 0;
+        logical->package = -1;
+        logical->die = 0;
+        logical->core = -1;
+        logical->thread = 0;
+        logical->node = -1;
+        logical->l3_group = -1;
+    }
+
+    // entries have variable sizes
+    for (entry = (const BYTE *)info; entry < (const BYTE *)info + size; entry += ((const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)entry)->Size)
+    {
+        const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *relation = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)entry;
+
+        switch (relation->Relationship)
+        {
+        case RelationProcessorCore:
+            // a core never spans several groups
+            for_each_cpu(*cpus, count, &relation->Processor.GroupMask[0], set_core, cores++);
+            break;
+
+        case RelationProcessorPackage:
+            for (i = 0; i < relation->Processor.GroupCount; ++i)
+            {
+                for_each_cpu(*cpus, count, &relation->Processor.GroupMask[i], set_package, packages);
+            }
+            ++packages;
+            break;
+
+        case RelationNumaNode:
+            for_each_cpu(*cpus, count, &relation->NumaNode.GroupMask, set_node, (int)relation->NumaNode.NodeNumber);
+            break;
+
+        case RelationCache:
+            if (relation->Cache.Level == 3)
+            {
+                for_each_cpu(*cpus, count, &relation->Cache.GroupMask, set_l3_group, first_cpu(&relation->Cache.GroupMask));
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        if (relation->Size == 0)
+        {
+            break;
+        }
+    }
+
+    free(info);
+
+    return count;
+}
+
+void os_release(void)
+{
+}
+
+int os_cpu_count(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return (int)info.dwNumberOfProcessors;
+}
+
+
+/* SystemProcessorPerformanceInformation entry, not declared by the SDK headers */
+typedef struct
+{
+    LARGE_INTEGER IdleTime;
+    LARGE_INTEGER KernelTime;       // includes idle, DPC and interrupt times
+    LARGE_INTEGER UserTime;
+    LARGE_INTEGER DpcTime;
+    LARGE_INTEGER InterruptTime;
+    ULONG InterruptCount;
+
+} processor_performance_t;
+
+typedef LONG (WINAPI *query_system_information_t)(int, PVOID, ULONG, ULONG *);
+
+#define SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION 8
+
+static uint64_t filetime_ticks(const FILETIME *time)
+{
+    return ((uint64_t)time->dwHighDateTime << 32) | time->dwLowDateTime;
+}
+
+static uint64_t clamped_difference(uint64_t value, uint64_t subtracted)
+{
+    return (value > subtracted) ? value - subtracted : 0;
+}
+
+// times are in 100 ns units, processors of the first group only
+int os_cpu_times(cpu_times_t *times, int max)
+{
+    static query_system_information_t query = NULL;
+    processor_performance_t processors[64];
+    FILETIME idle, kernel, user;
+    ULONG size = 0;
+    int count = 0;
+    int i = 0;
+
+    if (max < 1)
+    {
+        return 0;
+    }
+
+    if (query == NULL)
+    {
+        query = (query_system_information_t)GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtQuerySystemInformation");
+    }
+
+    memset(&times[0], 0, sizeof(times[0]));
+    times[0].cpu = -1;
+
+    if (query != NULL && query(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION, processors, sizeof(processors), &size) >= 0)
+    {
+        count = (int)(size / sizeof(processor_performance_t));
+
+        for (i = 0; i < count && i + 1 < max; ++i)
+        {
+            const processor_performance_t *processor = &processors[i];
+            cpu_times_t *cpu = &times[i + 1];
+            uint64_t busy = clamped_difference((uint64_t)processor->KernelTime.QuadPart, (uint64_t)processor->IdleTime.QuadPart);
+
+            memset(cpu, 0, sizeof(*cpu));
+            cpu->cpu = i;
+            cpu->user = (uint64_t)processor->UserTime.QuadPart;
+            cpu->idle = (uint64_t)processor->IdleTime.QuadPart;
+            cpu->softirq = (uint64_t)processor->DpcTime.QuadPart;
+            cpu->irq = (uint64_t)processor->InterruptTime.QuadPart;
+            cpu->system = clamped_difference(busy, cpu->softirq + cpu->irq);
+
+            times[0].user += cpu->user;
+            times[0].idle += cpu->idle;
+            times[0].softirq += cpu->softirq;
+            times[0].irq += cpu->irq;
+            times[0].system += cpu->system;
+        }
+
+        return i + 1;
+    }
+
+    // without ntdll only the sum of every processor is known
+    if (!GetSystemTimes(&idle, &kernel, &user))
+    {
+        return 0;
+    }
+
+    times[0].user = filetime_ticks(&user);
+    times[0].idle = filetime_ticks(&idle);
+    times[0].system = clamped_difference(filetime_ticks(&kernel), times[0].idle);
+
+    return 1;
+}
+
+// \\.\PhysicalDriveN are numbered from 0 but may have holes (removed USB drives)
+#define MAX_PHYSICAL_DRIVES 32
+
+// properties and counters need no access right, thus no administrator privileges either
+static HANDLE open_drive(int index)
+{
+    char path[32];
+
+    snprintf(path, sizeof(path), "\\\\.\\PhysicalDrive%d", index);
+
+    return CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+}
+
+static int query_property(HANDLE drive, STORAGE_PROPERTY_ID id, void *descriptor, DWORD size)
+{
+    STORAGE_PROPERTY_QUERY query;
+    DWORD returned = 0;
+
+    memset(&query, 0, sizeof(query));
+    memset(descriptor, 0, size);
+
+    query.PropertyId = id;
+    query.QueryType = PropertyStandardQuery;
+
+    return DeviceIoControl(drive, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), descriptor, size, &returned, NULL) && returned > 0;
+}
+
+/* StorageDeviceSeekPenaltyProperty appeared with Windows 8 and isn't declared by the Windows 7 SDK */
+#define STORAGE_DEVICE_SEEK_PENALTY_PROPERTY ((STORAGE_PROPERTY_ID)7)
+
+typedef struct
+{
+    DWORD Version;
+    DWORD Size;
+    BOOLEAN IncursSeekPenalty;
+
+} seek_penalty_t;
+
+static void read_drive(HANDLE drive, int index, disk_info_t *disk)
+{
+    union
+    {
+        STORAGE_DEVICE_DESCRIPTOR header;
+        char raw[512];
+
+    } device;
+    STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment;
+    DISK_GEOMETRY_EX geometry;
+    seek_penalty_t seek;
+    DWORD returned = 0;
+    int length = 0;
+
+    memset(disk, 0, sizeof(*disk));
+    snprintf(disk->name, sizeof(disk->name), "PhysicalDrive%d", index);
+
+    if (DeviceIoControl(drive, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &geometry, sizeof(geometry), &returned, NULL))
+    {
+        disk->size = (uint64_t)geometry.DiskSize.QuadPart;
+        disk->logical_block_size = geometry.Geometry.BytesPerSector;
+        disk->physical_block_size = geometry.Geometry.BytesPerSector;
+    }
+
+    // 512e drives report 512 bytes sectors in their geometry
+    if (query_property(drive, StorageAccessAlignmentProperty, &alignment, sizeof(alignment)))
+    {
+        disk->logical_block_size = alignment.BytesPerLogicalSector;
+        disk->physical_block_size = alignment.BytesPerPhysicalSector;
+    }
+
+    if (query_property(drive, STORAGE_DEVICE_SEEK_PENALTY_PROPERTY, &seek, sizeof(seek)))
+    {
+        disk->rotational = seek.IncursSeekPenalty ? 1 : 0;
+    }
+
+    if (query_property(drive, StorageDeviceProperty, &device, sizeof(device)))
+    {
+        // strings follow the descriptor and are truncated along with it
+        device.raw[sizeof(device.raw) - 1] = '\0';
+
+        disk->removable = device.header.RemovableMedia ? 1 : 0;
+
+        if (device.header.ProductIdOffset > 0 && device.header.ProductIdOffset < sizeof(device.raw))
+        {
+            snprintf(disk->model, sizeof(disk->model), "%s", device.raw + device.header.ProductIdOffset);
+        }
+
+        // padded with spaces, as under Linux
+        length = (int)strlen(disk->model);
+
+        while (length > 0 && disk->model[length - 1] == ' ')
+        {
+            disk->model[--length] = '\0';
+        }
+    }
+}
+
+int os_disks(disk_info_t **disks)
+{
+    int capacity = 0;
+    int count = 0;
+    int index = 0;
+
+    *disks = NULL;
+
+    for (index = 0; index < MAX_PHYSICAL_DRIVES; ++index)
+    {
+        HANDLE drive = open_drive(index);
+
+        if (drive == INVALID_HANDLE_VALUE)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            disk_info_t *grown = NULL;
+
+            capacity = (capacity == 0) ? 4 : 2 * capacity;
+            grown = (disk_info_t *)realloc(*disks, capacity * sizeof(disk_info_t));
+
+            if (grown == NULL)
+            {
+                CloseHandle(drive);
+                break;
+            }
+
+            *disks = grown;
+        }
+
+        read_drive(drive, index, &(*disks)[count]);
+        CloseHandle(drive);
+
+        // card readers without a card
+        if ((*disks)[count].size > 0)
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+// times of DISK_PERFORMANCE are in 100 ns units
+int os_disk_counters(disk_counters_t *counters, int max)
+{
+    FILETIME now;
+    uint64_t boot = 0;
+    int count = 0;
+    int index = 0;
+
+    // IdleTime is counted from boot while QueryTime is the current system time
+    GetSystemTimeAsFileTime(&now);
+    boot = clamped_difference(filetime_ticks(&now), GetTickCount64() * 10000);
+
+    for (index = 0; index < MAX_PHYSICAL_DRIVES && count < max; ++index)
+    {
+        HANDLE drive = open_drive(index);
+        disk_counters_t *entry = &counters[count];
+        DISK_PERFORMANCE performance;
+        DWORD returned = 0;
+        BOOL queried = FALSE;
+        uint64_t busy = 0;
+
+        if (drive == INVALID_HANDLE_VALUE)
+        {
+            continue;
+        }
+
+        queried = DeviceIoControl(drive, IOCTL_DISK_PERFORMANCE, NULL, 0, &performance, sizeof(performance), &returned, NULL);
+        CloseHandle(drive);
+
+        if (!queried)
+        {
+            continue;
+        }
+
+        memset(entry, 0, sizeof(*entry));
+        snprintf(entry->name, sizeof(entry->name), "PhysicalDrive%d", index);
+
+        entry->reads = performance.ReadCount;
+        entry->read_sectors = (uint64_t)performance.BytesRead.QuadPart / 512;
+        entry->read_ms = (uint64_t)performance.ReadTime.QuadPart / 10000;
+        entry->writes = performance.WriteCount;
+        entry->write_sectors = (uint64_t)performance.BytesWritten.QuadPart / 512;
+        entry->write_ms = (uint64_t)performance.WriteTime.QuadPart / 10000;
+        entry->in_flight = performance.QueueDepth;
+
+        // not counted by Windows : busy time is what isn't idle since boot, I/O times overlap like Linux weighted time
+        busy = clamped_difference(clamped_difference((uint64_t)performance.QueryTime.QuadPart, boot), (uint64_t)performance.IdleTime.QuadPart);
+        entry->io_ms = busy / 10000;
+        entry->queue_ms = entry->read_ms + entry->write_ms;
+
+        if (entry->reads != 0 || entry->writes != 0 || entry->in_flight != 0)
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+// GlobalMemoryStatus() saturates at 4 GB in 32 bits processes
+int os_meminfo(meminfo_t *info)
+{
+    MEMORYSTATUSEX status;
+    PERFORMANCE_INFORMATION performance;
+
+    memset(info, 0, sizeof(*info));
+
+    status.dwLength = sizeof(status);
+
+    if (!GlobalMemoryStatusEx(&status))
+    {
+        return FALSE;
+    }
+
+    info->total = status.ullTotalPhys;
+    info->free = status.ullAvailPhys;
+    info->available = status.ullAvailPhys;
+
+    // the page file figures are the commit limit and include physical memory
+    info->swap_total = clamped_difference(status.ullTotalPageFile, status.ullTotalPhys);
+    info->swap_free = clamped_difference(status.ullAvailPageFile, status.ullAvailPhys);
+
+    if (info->swap_free > info->swap_total)
+    {
+        info->swap_free = info->swap_total;
+    }
+
+    performance.cb = sizeof(performance);
+
+    if (GetPerformanceInfo(&performance, sizeof(performance)))
+    {
+        info->cached = (uint64_t)performance.SystemCache * performance.PageSize;
+    }
+
+    return TRUE;
+}
+
+static double filetime_seconds(const FILETIME *time)
+{
+    return filetime_ticks(time) / 1e7;
+}
+
+int os_process_info(process_info_t *info)
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    FILETIME creation, exit, kernel, user;
+    int collected = FALSE;
+
+    memset(info, 0, sizeof(*info));
+
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        info->user_time = filetime_seconds(&user);
+        info->system_time = filetime_seconds(&kernel);
+        collected = TRUE;
+    }
+
+    counters.cb = sizeof(counters);
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        info->rss = counters.WorkingSetSize;
+        info->peak_rss = counters.PeakWorkingSetSize;
+        info->virtual_size = counters.PagefileUsage;
+        info->minor_faults = counters.PageFaultCount;
+        collected = TRUE;
+    }
+
+    return collected;
+}
+
+/* ProcessorInformation entry, only declared by the DDK */
+typedef struct
+{
+    ULONG Number;
+    ULONG MaxMhz;
+    ULONG CurrentMhz;
+    ULONG MhzLimit;
+    ULONG MaxIdleState;
+    ULONG CurrentIdleState;
+
+} processor_power_t;
+
+// processors of the first group only, the minimum frequency isn't known
+int os_cpu_freqs(cpu_freq_t *freqs, int max)
+{
+    processor_power_t processors[64];
+    int count = os_cpu_count();
+    int i = 0;
+
+    if (count > 64)
+    {
+        count = 64;
+    }
+
+    if (CallNtPowerInformation(ProcessorInformation, NULL, 0, processors, (ULONG)(count * sizeof(processor_power_t))) != 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < count && i < max; ++i)
+    {
+        freqs[i].cpu = (int)processors[i].Number;
+        freqs[i].cur_khz = processors[i].CurrentMhz * 1000;
+        freqs[i].min_khz = 0;
+        freqs[i].max_khz = processors[i].MaxMhz * 1000;
+    }
+
+    return i;
+}
+
+typedef struct
+{
+    void (*entry)(void *arg);
+    void *arg;
+    HANDLE thread;
+
+} os_thread_t;
+
+static DWORD WINAPI thread_main(LPVOID arg)
+{
+    os_thread_t *thread = (os_thread_t *)arg;
+
+    thread->entry(thread->arg);
+
+    return 0;
+}
+
+void *os_thread_create(void (*entry)(void *arg), void *arg)
+{
+    os_thread_t *thread = (os_thread_t *)malloc(sizeof(os_thread_t));
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->thread = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+
+    if (thread->thread == NULL)
+    {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void os_thread_join(void *thread)
+{
+    WaitForSingleObject(((os_thread_t *)thread)->thread, INFINITE);
+    CloseHandle(((os_thread_t *)thread)->thread);
+    free(thread);
+}
+
+void os_yield(void)
+{
+    Sleep(0);
+}
+
+void os_sleep(double seconds)
+{
+    Sleep((DWORD)(seconds * 1000.0 + 0.5));
+}
+
+const void *os_map_file(const char *filename, size_t *size)
+{
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping = NULL;
+    LARGE_INTEGER length;
+    const void *data = NULL;
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0 && (ULONGLONG)length.QuadPart <= (SIZE_T)-1)
+    {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+
+    if (mapping != NULL)
+    {
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+        // the view keeps the mapping and the file open
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+
+    if (data != NULL)
+    {
+        *size = (size_t)length.QuadPart;
+    }
+
+    return data;
+}
+
+void os_unmap_file(const void *data, size_t size)
+{
+    UnmapViewOfFile(data);
+}
+
+int os_current_cpu(void)
+{
+    return (int)GetCurrentProcessorNumber();
+}
+
+// only processors of the current processor group (at most 64) are handled
+int os_get_affinity(int *cpus, int max)
+{
+    DWORD_PTR process = 0;
+    DWORD_PTR system = 0;
+    DWORD_PTR mask = 0;
+    int count = 0;
+    int cpu = 0;
+
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+    {
+        return 0;
+    }
+
+    // the only way to read the mask of a thread is to change it
+    mask = SetThreadAffinityMask(GetCurrentThread(), process);
+
+    if (mask == 0)
+    {
+        return 0;
+    }
+
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+
+    for (cpu = 0; cpu < (int)(8 * sizeof(DWORD_PTR)) && count < max; ++cpu)
+    {
+        if ((mask >> cpu) & 1)
+        {
+            cpus[count++] = cpu;
+        }
+    }
+
+    return count;
+}
+
+int os_set_affinity(const int *cpus, int count)
+{
+    DWORD_PTR mask = 0;
+    int i = 0;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (cpus[i] < 0 || cpus[i] >= (int)(8 * sizeof(DWORD_PTR)))
+        {
+            return FALSE;
+        }
+
+        mask |= (DWORD_PTR)1 << cpus[i];
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+uint32_t os_perf_open(void)
+{
+    return 0;
+}
+
+int os_perf_read(perf_sample_t *sample)
+{
+    memset(sample, 0, sizeof(*sample));
+    return FALSE;
+}
@@ -0,0 +1,199 @@
+/*
+** SFP (SysFootPrint) Hollywood plugin
+** Copyright (C) 2020 Christophe Gouiran <bechris13250@gmail.com>
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in
+** all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+** IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+** CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+** TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+** SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <hollywood/plugin.h>
+
+#include "sfpplugin.h"
+
+// how long the TSC is compared to the monotonic clock when CPUID doesn't give its frequency
+#define CALIBRATION_SECONDS 0.02
+
+// readings used to measure resolution and overhead
+#define PROBE_READINGS 1000
+
+static timer_info_t info;
+static int initialized = FALSE;
+
+// ticks are returned relative to this base so that they stay exact once converted to Hollywood numbers
+static uint64_t base = 0;
+
+static uint64_t raw_ticks(void)
+{
+	unsigned int aux = 0;
+
+	switch (info.source)
+	{
+	case TIMER_RDTSCP:
+		return __rdtscp(&aux);
+	case TIMER_RDTSC:
+		return __rdtsc();
+	default:
+		return (uint64_t)(monotonic_seconds() * 1e9);
+	}
+}
+
+/* Returns TSC frequency from CPUID leaf 0x15 (crystal clock ratio) or 0x16 (base frequency), 0 if unknown */
+static double cpuid_tsc_frequency(const cpuid_snapshot_t *snap, const char **source)
+{
+	const uint32_t *regs = cpuid_leaf(snap, 0x15, 0);
+
+	if (regs != NULL && regs[0] != 0 && regs[1] != 0 && regs[2] != 0)
+	{
+		*source = "cpuid.15";
+		return (double)regs[2] * regs[1] / regs[0];
+	}
+
+	regs = cpuid_leaf(snap, 0x16, 0);
+
+	if (regs != NULL && (regs[0] & 0xFFFF) != 0)
+	{
+		*source = "cpuid.16";
+		return (regs[0] & 0xFFFF) * 1e6;
+	}
+
+	return 0.0;
+}
+
+static double calibrate_tsc(void)
+{
+	double start = monotonic_seconds();
+	uint64_t tsc_start = raw_ticks();
+	double elapsed = 0.0;
+
+	do
+	{
+		elapsed = monotonic_seconds() - start;
+	}
+	while (elapsed < CALIBRATION_SECONDS);
+
+	return (double)(raw_ticks() - tsc_start) / elapsed;
+}
+
+static void probe(void)
+{
+	uint64_t smallest = 0;
+	uint64_t previous = raw_ticks();
+	uint64_t first = previous;
+	int i = 0;
+
+	for (i = 0; i < PROBE_READINGS; ++i)
+	{
+		uint64_t now = raw_ticks();
+
+		if (now > previous && (smallest == 0 || now - previous < smallest))
+		{
+			smallest = now - previous;
+		}
+
+		previous = now;
+	}
+
+	info.resolution_ns = smallest * info.ns_per_tick;
+	info.overhead_ns = (double)(previous - first) * info.ns_per_tick / PROBE_READINGS;
+}
+
+/* Chooses the time source (TSC only if it is invariant) and measures its frequency, resolution and overhead
+** Only the first call does it : ticks already handed out must keep their origin and scale */
+void timer_init(void)
+{
+	const cpuid_snapshot_t *snap = NULL;
+	const uint32_t *leaf1 = NULL;
+	const uint32_t *power = NULL;
+	const uint32_t *ext = NULL;
+	int has_tsc = FALSE;
+
+	if (initialized)
+	{
+		return;
+	}
+
+	snap = cpuid_snapshot();
+	leaf1 = cpuid_leaf(snap, 1, 0);
+	power = cpuid_leaf(snap, 0x80000007, 0);
+	ext = cpuid_leaf(snap, 0x80000001, 0);
+	has_tsc = (leaf1 != NULL) && ((leaf1[3] >> 4) & 1);
+
+	memset(&info, 0, sizeof(info));
+
+	info.invariant = (power != NULL) && ((power[3] >> 8) & 1);
+	info.source = TIMER_CLOCK;
+
+	if (has_tsc && info.invariant)
+	{
+		info.source = ((ext != NULL) && ((ext[3] >> 27) & 1)) ? TIMER_RDTSCP : TIMER_RDTSC;
+		info.frequency = cpuid_tsc_frequency(snap, &info.frequency_source);
+
+		if (info.frequency == 0.0)
+		{
+			info.frequency_source = "calibrated";
+			info.frequency = calibrate_tsc();
+		}
+	}
+
+	if (info.frequency <= 0.0)
+	{
+		info.source = TIMER_CLOCK;
+		info.frequency_source = "clock";
+		info.frequency = 1e9;
+	}
+
+	info.ns_per_tick = 1e9 / info.frequency;
+
+	probe();
+
+	base = raw_ticks();
+	initialized = TRUE;
+}
+
+uint64_t timer_ticks(void)
+{
+	if (initialized == FALSE)
+	{
+		timer_init();
+	}
+
+	return raw_ticks() - base;
+}
+
+double timer_ticks_to_ns(double ticks)
+{
+	if (initialized == FALSE)
+	{
+		timer_init();
+	}
+
+	return ticks * info.ns_per_tick;
+}
+
+const timer_info_t *timer_get_info(void)
+{
+	if (initialized == FALSE)
+	{
+		timer_init();
+	}
+
+	return &info;
+}